@@ -67,22 +67,22 @@ namespace ns3
         {
         case PIM_HELLO:
           //NS_LOG_DEBUG ("Hello Message Size: " << size << " + " << m_pim_message.hello.GetSerializedSize ());
-          size += m_pim_message.hello.GetSerializedSize();
+          size += PeekBody<HelloMessage>(PIM_HELLO).GetSerializedSize();
           break;
         case PIM_JP:
-          size += m_pim_message.joinPrune.GetSerializedSize();
+          size += PeekBody<JoinPruneMessage>(PIM_JP).GetSerializedSize();
           break;
         case PIM_ASSERT:
-          size += m_pim_message.assert.GetSerializedSize();
+          size += PIM_DM_ASSERT;
           break;
         case PIM_GRAFT:
-          size += m_pim_message.graft.GetSerializedSize();
+          size += PeekBody<GraftMessage>(PIM_GRAFT).GetSerializedSize();
           break;
         case PIM_GRAFT_ACK:
-          size += m_pim_message.graftAck.GetSerializedSize();
+          size += PeekBody<GraftAckMessage>(PIM_GRAFT_ACK).GetSerializedSize();
           break;
         case PIM_STATE_REF:
-          size += m_pim_message.stateRefresh.GetSerializedSize();
+          size += PIM_DM_REFRESH;
           break;
         default:
           {
@@ -107,29 +107,29 @@ namespace ns3
     PIMHeader::Serialize (Buffer::Iterator start) const
     {
       Buffer::Iterator i = start;
-      uint16_t header = m_version << 12 | m_type << 8 | m_reserved;
-      i.WriteHtonU32(0);
+      i.Next(PIM_DM_HEADER_SIZE);
+      ChecksumIterator body(i); // the checksum covers the message body and is summed while it is written
       switch (m_type)
         {
         case PIM_HELLO:
           {
-            m_pim_message.hello.Serialize(i);
+            PeekBody<HelloMessage>(PIM_HELLO).Serialize(body);
             break;
           }
         case PIM_JP:
-          m_pim_message.joinPrune.Serialize(i);
+          PeekBody<JoinPruneMessage>(PIM_JP).Serialize(body);
           break;
         case PIM_ASSERT:
-          m_pim_message.assert.Serialize(i);
+          PeekBody<AssertMessage>(PIM_ASSERT).Serialize(body);
           break;
         case PIM_GRAFT:
-          m_pim_message.graft.Serialize(i);
+          PeekBody<GraftMessage>(PIM_GRAFT).Serialize(body);
           break;
         case PIM_GRAFT_ACK:
-          m_pim_message.graftAck.Serialize(i);
+          PeekBody<GraftAckMessage>(PIM_GRAFT_ACK).Serialize(body);
           break;
         case PIM_STATE_REF:
-          m_pim_message.stateRefresh.Serialize(i);
+          PeekBody<StateRefreshMessage>(PIM_STATE_REF).Serialize(body);
           break;
         default:
           {
@@ -138,18 +138,14 @@ namespace ns3
           }
         }
       i = start;
-      i.Next(4);
-      uint16_t checksum = i.CalculateIpChecksum(GetSerializedSize() - 4, 0);
-      i = start;
-      i.WriteHtonU16(header);
-      i.WriteHtonU16(checksum);
+      i.WriteHtonU16(m_version << 12 | m_type << 8 | m_reserved);
+      i.WriteHtonU16(body.GetChecksum());
     }
 
     uint32_t
     PIMHeader::Deserialize (Buffer::Iterator start)
     {
       Buffer::Iterator i = start;
-      uint16_t checksum = 0;
       uint32_t size = PIM_DM_HEADER_SIZE;
       uint16_t ver_type = i.ReadNtohU16();
       m_version = m_reserved = m_checksum = 0;
@@ -160,25 +156,27 @@ namespace ns3
       m_checksum = i.ReadNtohU16();			// 00000000 00000000 11111111 11111111
       uint32_t message_size = i.GetSize();
       NS_ASSERT(message_size >0);
+      m_body = 0; // the body may be shared with the header this one was copied from
+      ChecksumIterator body(i);
       switch (m_type)
         {
         case PIM_HELLO:
-          size += m_pim_message.hello.Deserialize(i, message_size - size);
+          size += GetHelloMessage().Deserialize(body, message_size - size);
           break;
         case PIM_JP:
-          size += m_pim_message.joinPrune.Deserialize(i, message_size - size);
+          size += GetJoinPruneMessage().Deserialize(body, message_size - size);
           break;
         case PIM_ASSERT:
-          size += m_pim_message.assert.Deserialize(i, message_size - size);
+          size += GetAssertMessage().Deserialize(body, message_size - size);
           break;
         case PIM_GRAFT:
-          size += m_pim_message.graft.Deserialize(i, message_size - size);
+          size += GetGraftMessage().Deserialize(body, message_size - size);
           break;
         case PIM_GRAFT_ACK:
-          size += m_pim_message.graftAck.Deserialize(i, message_size - size);
+          size += GetGraftAckMessage().Deserialize(body, message_size - size);
           break;
         case PIM_STATE_REF:
-          size += m_pim_message.stateRefresh.Deserialize(i, message_size - size);
+          size += GetStateRefreshMessage().Deserialize(body, message_size - size);
           break;
         default:
           {
@@ -186,10 +184,7 @@ namespace ns3
             break;
           }
         }
-      i = start;
-      i.Next(4);
-      checksum = i.CalculateIpChecksum(GetSerializedSize() - 4, 0);
-      NS_ASSERT_MSG(checksum == m_checksum, "Checksum error");
+      NS_ASSERT_MSG(body.GetChecksum() == m_checksum, "Checksum error");
       return size;
     }
 
@@ -209,18 +204,16 @@ namespace ns3
     }
 
     void
-    PIMHeader::EncodedUnicast::Serialize (Buffer::Iterator start) const
+    PIMHeader::EncodedUnicast::Serialize (ChecksumIterator &i) const
     {
-      Buffer::Iterator i = start;
       i.WriteU8(this->m_addressFamily);
       i.WriteU8(this->m_encodingType);
       i.WriteHtonU32(this->m_unicastAddress.Get());
     }
 
     uint32_t
-    PIMHeader::EncodedUnicast::Deserialize (Buffer::Iterator start, uint32_t messageSize)
+    PIMHeader::EncodedUnicast::Deserialize (ChecksumIterator &i, uint32_t messageSize)
     {
-      Buffer::Iterator i = start;
       NS_ASSERT(messageSize == PIM_DM_ENC_UNI);
       this->m_addressFamily = i.ReadU8();
       this->m_encodingType = i.ReadU8();
@@ -246,9 +239,8 @@ namespace ns3
     }
 
     void
-    PIMHeader::EncodedGroup::Serialize (Buffer::Iterator start) const
+    PIMHeader::EncodedGroup::Serialize (ChecksumIterator &i) const
     {
-      Buffer::Iterator i = start;
       i.WriteU8(this->m_addressFamily);
       i.WriteU8(this->m_encodingType);
       uint8_t BRZ = this->m_B << 7 | (this->m_reserved << 1 & 0x7e) | this->m_Z;
@@ -258,9 +250,8 @@ namespace ns3
     }
 
     uint32_t
-    PIMHeader::EncodedGroup::Deserialize (Buffer::Iterator start, uint32_t messageSize)
+    PIMHeader::EncodedGroup::Deserialize (ChecksumIterator &i, uint32_t messageSize)
     {
-      Buffer::Iterator i = start;
       uint16_t size = 0;
       NS_ASSERT(messageSize == PIM_DM_ENC_GRP);
       this->m_addressFamily = i.ReadU8();
@@ -294,9 +285,8 @@ namespace ns3
     }
 
     void
-    PIMHeader::EncodedSource::Serialize (Buffer::Iterator start) const
+    PIMHeader::EncodedSource::Serialize (ChecksumIterator &i) const
     {
-      Buffer::Iterator i = start;
       i.WriteU8(this->m_addressFamily);
       i.WriteU8(this->m_encodingType);
       uint8_t RSWR = this->m_reserved << 3 | (this->m_S << 2 & 0x04) | (this->m_W << 1 & 0x02) | (this->m_R & 0x01);
@@ -306,9 +296,8 @@ namespace ns3
     }
 
     uint32_t
-    PIMHeader::EncodedSource::Deserialize (Buffer::Iterator start, uint32_t messageSize)
+    PIMHeader::EncodedSource::Deserialize (ChecksumIterator &i, uint32_t messageSize)
     {
-      Buffer::Iterator i = start;
       uint16_t size = 0;
       NS_ASSERT(messageSize == PIM_DM_ENC_GRP);
       this->m_addressFamily = i.ReadU8();
@@ -388,9 +377,8 @@ namespace ns3
     }
 
     void
-    PIMHeader::HelloMessage::Serialize (Buffer::Iterator start) const
+    PIMHeader::HelloMessage::Serialize (ChecksumIterator &i) const
     {
-      Buffer::Iterator i = start;
       for (std::vector<HelloEntry>::const_iterator iter = this->m_optionList.begin(); iter != this->m_optionList.end();
           iter++)
         {
@@ -441,9 +429,8 @@ namespace ns3
     }
 
     uint32_t
-    PIMHeader::HelloMessage::Deserialize (Buffer::Iterator start, uint32_t messageSize)
+    PIMHeader::HelloMessage::Deserialize (ChecksumIterator &i, uint32_t messageSize)
     {
-      Buffer::Iterator i = start;
       NS_ASSERT(messageSize >= 4);
       this->m_optionList.clear();
       uint16_t helloSizeLeft = messageSize;
@@ -517,12 +504,9 @@ namespace ns3
     }
 
     void
-    PIMHeader::JoinPruneGraftMessage::Serialize (Buffer::Iterator start) const
+    PIMHeader::JoinPruneGraftMessage::Serialize (ChecksumIterator &i) const
     {
-      Buffer::Iterator i = start;
       this->m_upstreamNeighborAddr.Serialize(i);
-      uint16_t size = this->m_upstreamNeighborAddr.GetSerializedSize();
-      i.Next(size);
       i.WriteU8(this->m_reserved);
       i.WriteU8(this->m_numGroups);
       uint16_t hold = (uint16_t) this->m_holdTime.GetSeconds();
@@ -530,12 +514,10 @@ namespace ns3
     }
 
     uint32_t
-    PIMHeader::JoinPruneGraftMessage::Deserialize (Buffer::Iterator start, uint32_t messageSize)
+    PIMHeader::JoinPruneGraftMessage::Deserialize (ChecksumIterator &i, uint32_t messageSize)
     {
-      Buffer::Iterator i = start;
       NS_ASSERT(messageSize == this->GetSerializedSize());
       uint16_t size = this->m_upstreamNeighborAddr.Deserialize(i, PIM_DM_ENC_UNI);
-      i.Next(size);
       this->m_reserved = i.ReadU8();
       this->m_numGroups = i.ReadU8();
       uint16_t hold = i.ReadNtohU16();
@@ -570,11 +552,9 @@ namespace ns3
     }
 
     void
-    PIMHeader::MulticastGroupEntry::Serialize (Buffer::Iterator start) const
+    PIMHeader::MulticastGroupEntry::Serialize (ChecksumIterator &i) const
     {
-      Buffer::Iterator i = start;
       this->m_multicastGroupAddr.Serialize(i);
-      i.Next(this->m_multicastGroupAddr.GetSerializedSize());
       i.WriteHtonU16(this->m_numberJoinedSources);
       NS_ASSERT(this->m_numberJoinedSources == this->m_joinedSourceAddrs.size());
       i.WriteHtonU16(this->m_numberPrunedSources);
@@ -583,22 +563,18 @@ namespace ns3
           iter != this->m_joinedSourceAddrs.end(); iter++)
         {
           iter->Serialize(i);
-          i.Next(iter->GetSerializedSize());
         }
       for (std::vector<EncodedSource>::const_iterator iter = this->m_prunedSourceAddrs.begin();
           iter != this->m_prunedSourceAddrs.end(); iter++)
         {
           iter->Serialize(i);
-          i.Next(iter->GetSerializedSize());
         }
     }
 
     uint32_t
-    PIMHeader::MulticastGroupEntry::Deserialize (Buffer::Iterator start, uint32_t messageSize)
+    PIMHeader::MulticastGroupEntry::Deserialize (ChecksumIterator &i, uint32_t messageSize)
     {
-      Buffer::Iterator i = start;
       uint16_t size = this->m_multicastGroupAddr.Deserialize(i, this->m_multicastGroupAddr.GetSerializedSize());
-      i.Next(size);
       this->m_numberJoinedSources = i.ReadNtohU16();
       this->m_numberPrunedSources = i.ReadNtohU16();
       size += 4;
@@ -608,14 +584,12 @@ namespace ns3
           this->m_joinedSourceAddrs.push_back(join);
           uint16_t len = this->m_joinedSourceAddrs[j].GetSerializedSize();
           size += this->m_joinedSourceAddrs[j].Deserialize(i, len);
-          i.Next(this->m_joinedSourceAddrs[j].GetSerializedSize());
         }
       for (uint16_t j = 0; j < this->m_numberPrunedSources; j++)
         {
           struct EncodedSource prune;
           uint16_t len = prune.GetSerializedSize();
           size += prune.Deserialize(i, len);
-          i.Next(prune.GetSerializedSize());
           this->m_prunedSourceAddrs.push_back(prune);
         }
       return size;
@@ -643,31 +617,25 @@ namespace ns3
     }
 
     void
-    PIMHeader::JoinPruneMessage::Serialize (Buffer::Iterator start) const
+    PIMHeader::JoinPruneMessage::Serialize (ChecksumIterator &i) const
     {
-      Buffer::Iterator i = start;
       this->m_joinPruneMessage.Serialize(i);
-      i.Next(this->m_joinPruneMessage.GetSerializedSize());
       for (std::vector<struct MulticastGroupEntry>::const_iterator iter = this->m_multicastGroups.begin();
           iter != this->m_multicastGroups.end(); iter++)
         {
           iter->Serialize(i);
-          i.Next(iter->GetSerializedSize());
         }
     }
 
     uint32_t
-    PIMHeader::JoinPruneMessage::Deserialize (Buffer::Iterator start, uint32_t messageSize)
+    PIMHeader::JoinPruneMessage::Deserialize (ChecksumIterator &i, uint32_t messageSize)
     {
-      Buffer::Iterator i = start;
       uint16_t size = this->m_joinPruneMessage.Deserialize(i, PIM_DM_JPG);
-      i.Next(size);
       for (uint8_t j = 0; j < (uint16_t) this->m_joinPruneMessage.m_numGroups; j++)
         {
           MulticastGroupEntry mge;
           this->m_multicastGroups.push_back(mge);
           uint16_t len = this->m_multicastGroups[j].Deserialize(i, i.GetSize());
-          i.Next(this->m_multicastGroups[j].GetSerializedSize());
           size += len;
         }
       return size;
@@ -695,31 +663,25 @@ namespace ns3
     }
 
     void
-    PIMHeader::GraftMessage::Serialize (Buffer::Iterator start) const
+    PIMHeader::GraftMessage::Serialize (ChecksumIterator &i) const
     {
-      Buffer::Iterator i = start;
       this->m_joinPruneMessage.Serialize(i);
-      i.Next(this->m_joinPruneMessage.GetSerializedSize());
       for (std::vector<struct MulticastGroupEntry>::const_iterator iter = this->m_multicastGroups.begin();
           iter != this->m_multicastGroups.end(); iter++)
         {
           iter->Serialize(i);
-          i.Next(iter->GetSerializedSize());
         }
     }
 
     uint32_t
-    PIMHeader::GraftMessage::Deserialize (Buffer::Iterator start, uint32_t messageSize)
+    PIMHeader::GraftMessage::Deserialize (ChecksumIterator &i, uint32_t messageSize)
     {
-      Buffer::Iterator i = start;
       uint16_t size = this->m_joinPruneMessage.Deserialize(i, PIM_DM_JPG);
-      i.Next(size);
       for (uint8_t j = 0; j < (uint16_t) this->m_joinPruneMessage.m_numGroups; j++)
         {
           MulticastGroupEntry mge;
           this->m_multicastGroups.push_back(mge);
           uint16_t len = this->m_multicastGroups[j].Deserialize(i, i.GetSize());
-          i.Next(this->m_multicastGroups[j].GetSerializedSize());
           size += len;
         }
       return size;
@@ -747,31 +709,25 @@ namespace ns3
     }
 
     void
-    PIMHeader::GraftAckMessage::Serialize (Buffer::Iterator start) const
+    PIMHeader::GraftAckMessage::Serialize (ChecksumIterator &i) const
     {
-      Buffer::Iterator i = start;
       this->m_joinPruneMessage.Serialize(i);
-      i.Next(this->m_joinPruneMessage.GetSerializedSize());
       for (std::vector<struct MulticastGroupEntry>::const_iterator iter = this->m_multicastGroups.begin();
           iter != this->m_multicastGroups.end(); iter++)
         {
           iter->Serialize(i);
-          i.Next(iter->GetSerializedSize());
         }
     }
 
     uint32_t
-    PIMHeader::GraftAckMessage::Deserialize (Buffer::Iterator start, uint32_t messageSize)
+    PIMHeader::GraftAckMessage::Deserialize (ChecksumIterator &i, uint32_t messageSize)
     {
-      Buffer::Iterator i = start;
       uint16_t size = this->m_joinPruneMessage.Deserialize(i, PIM_DM_JPG);
-      i.Next(size);
       for (uint8_t j = 0; j < (uint16_t) this->m_joinPruneMessage.m_numGroups; j++)
         {
           MulticastGroupEntry mge;
           this->m_multicastGroups.push_back(mge);
           uint16_t len = this->m_multicastGroups[j].Deserialize(i, i.GetSize());
-          i.Next(this->m_multicastGroups[j].GetSerializedSize());
           size += len;
         }
       return size;
@@ -795,27 +751,21 @@ namespace ns3
     }
 
     void
-    PIMHeader::AssertMessage::Serialize (Buffer::Iterator start) const
+    PIMHeader::AssertMessage::Serialize (ChecksumIterator &i) const
     {
-      Buffer::Iterator i = start;
       this->m_multicastGroupAddr.Serialize(i);
-      i.Next(this->m_multicastGroupAddr.GetSerializedSize());
       this->m_sourceAddr.Serialize(i);
-      i.Next(this->m_sourceAddr.GetSerializedSize());
       i.WriteHtonU32(this->m_destination.Get());
       i.WriteHtonU32(this->m_R << 31 | (this->m_metricPreference & 0x7FFFFFFF));
       i.WriteHtonU32(this->m_metric);
     }
 
     uint32_t
-    PIMHeader::AssertMessage::Deserialize (Buffer::Iterator start, uint32_t messageSize)
+    PIMHeader::AssertMessage::Deserialize (ChecksumIterator &i, uint32_t messageSize)
     {
-      Buffer::Iterator i = start;
       NS_ASSERT(messageSize == this->GetSerializedSize());
       uint16_t size = this->m_multicastGroupAddr.Deserialize(i, PIM_DM_ENC_GRP);
-      i.Next(PIM_DM_ENC_GRP);
       size += this->m_sourceAddr.Deserialize(i, PIM_DM_ENC_UNI);
-      i.Next(PIM_DM_ENC_UNI);
       m_destination = Ipv4Address(i.ReadNtohU32());
       uint32_t RM = i.ReadNtohU32();
       this->m_R = (RM & 0x80000000) >> 31;
@@ -847,34 +797,28 @@ namespace ns3
     }
 
     void
-    PIMHeader::StateRefreshMessage::Serialize (Buffer::Iterator start) const
+    PIMHeader::StateRefreshMessage::Serialize (ChecksumIterator &i) const
     {
-      Buffer::Iterator i = start;
       this->m_multicastGroupAddr.Serialize(i);
-      i.Next(this->m_multicastGroupAddr.GetSerializedSize());
       this->m_sourceAddr.Serialize(i);
-      i.Next(this->m_sourceAddr.GetSerializedSize());
       this->m_originatorAddr.Serialize(i);
-      i.Next(this->m_originatorAddr.GetSerializedSize());
       i.WriteHtonU32((this->m_R & 0x1) << 31 | (this->m_metricPreference & 0x7fffffff));
       i.WriteHtonU32(this->m_metric);
       i.WriteU8(this->m_maskLength);
       i.WriteU8(this->m_ttl);
       i.WriteU8(this->m_P << 7 | (this->m_N & 0x01) << 6 | (this->m_O & 0x01) << 5 | (this->m_reserved & 0x1f));
       i.WriteU8(this->m_interval);
+      for (uint32_t pad = PIM_DM_REFRESH - PIM_DM_REFRESH_PAD; pad < PIM_DM_REFRESH; pad += 4)
+        i.WriteHtonU32(0);
     }
 
     uint32_t
-    PIMHeader::StateRefreshMessage::Deserialize (Buffer::Iterator start, uint32_t messageSize)
+    PIMHeader::StateRefreshMessage::Deserialize (ChecksumIterator &i, uint32_t messageSize)
     {
-      Buffer::Iterator i = start;
       NS_ASSERT(messageSize == this->GetSerializedSize());
       uint16_t size = this->m_multicastGroupAddr.Deserialize(i, PIM_DM_ENC_GRP);
-      i.Next(PIM_DM_ENC_GRP);
       size += this->m_sourceAddr.Deserialize(i, PIM_DM_ENC_UNI);
-      i.Next(PIM_DM_ENC_UNI);
       size += this->m_originatorAddr.Deserialize(i, PIM_DM_ENC_UNI);
-      i.Next(PIM_DM_ENC_UNI);
       uint32_t RM = i.ReadNtohU32();
       this->m_R = (RM & 0x80000000) >> 31;
       this->m_metricPreference = RM & 0x7FFFFFFF;
@@ -890,8 +834,119 @@ namespace ns3
       this->m_reserved = (PNOR & 0x1f);
       this->m_interval = i.ReadU8();
       size += 4;
+      for (; size < PIM_DM_REFRESH; size += 4)
+        i.ReadNtohU32();
       return size;
     }
 
+    void
+    PIMHeader::PatchStateRefresh (std::vector<uint8_t> &bytes, const StateRefreshMessage &refresh)
+    {
+      NS_ASSERT(bytes.size() == PIM_DM_HEADER_SIZE + PIM_DM_REFRESH);
+      PatchByte(bytes, PIM_DM_REFRESH_TTL, refresh.m_ttl);
+      PatchByte(bytes, PIM_DM_REFRESH_TTL + 1,
+          refresh.m_P << 7 | (refresh.m_N & 0x01) << 6 | (refresh.m_O & 0x01) << 5 | (refresh.m_reserved & 0x1f));
+    }
+
+    void
+    PIMHeader::PatchByte (std::vector<uint8_t> &bytes, uint32_t offset, uint8_t value)
+    {
+      if (bytes[offset] == value)
+        return;
+      // the checksum is kept in the byte order of Buffer::Iterator::CalculateIpChecksum, words read low byte first
+      uint32_t word = offset & ~1u;
+      uint16_t before = bytes[word] | bytes[word + 1] << 8;
+      bytes[offset] = value;
+      uint16_t after = bytes[word] | bytes[word + 1] << 8;
+      uint32_t sum = (uint16_t) ~(bytes[2] << 8 | bytes[3]) + (uint16_t) ~before + after;
+      sum = (sum & 0xffff) + (sum >> 16);
+      sum = (sum & 0xffff) + (sum >> 16);
+      uint16_t checksum = ~sum;
+      bytes[2] = checksum >> 8;
+      bytes[3] = checksum & 0xff;
+    }
+
+// ---------------- PIM-DM JOIN PRUNE GRAFT view ------------------------
+
+    JoinPruneGraftView::JoinPruneGraftView (const uint8_t *data, uint32_t size) :
+        m_data(data), m_size(size), m_offset(PIM_DM_HEADER_SIZE + PIM_DM_JPG), m_groupsLeft(0), m_joinsLeft(0),
+        m_prunesLeft(0), m_join(false)
+    {
+      NS_ASSERT(size >= PIM_DM_HEADER_SIZE);
+      // same check as PIMHeader::Deserialize, on the body only; the checksum was computed on words read low byte first
+      uint32_t sum = data[3] << 8 | data[2];
+      for (uint32_t j = PIM_DM_HEADER_SIZE; j + 1 < size; j += 2)
+        sum += ReadU16(j);
+      if (size % 2)
+        sum += data[size - 1] << 8;
+      while (sum >> 16)
+        sum = (sum & 0xffff) + (sum >> 16);
+      NS_ASSERT_MSG(sum == 0xffff, "Checksum error");
+      if (size < PIM_DM_HEADER_SIZE + PIM_DM_JPG)
+        return;
+      uint32_t i = PIM_DM_HEADER_SIZE;
+      m_message.m_upstreamNeighborAddr.m_addressFamily = data[i];
+      m_message.m_upstreamNeighborAddr.m_encodingType = data[i + 1];
+      m_message.m_upstreamNeighborAddr.m_unicastAddress = Ipv4Address(ReadU32(i + 2));
+      i += PIM_DM_ENC_UNI;
+      m_message.m_reserved = data[i];
+      m_message.m_numGroups = data[i + 1];
+      m_message.m_holdTime = Seconds(ReadU16(i + 2));
+      m_groupsLeft = m_message.m_numGroups;
+    }
+
+    bool
+    JoinPruneGraftView::Next ()
+    {
+      while (m_joinsLeft == 0 && m_prunesLeft == 0)
+        {
+          if (m_groupsLeft == 0 || m_offset + PIM_DM_ENC_GRP + 4 > m_size)
+            return false;
+          m_groupsLeft--;
+          m_group.m_addressFamily = m_data[m_offset];
+          m_group.m_encodingType = m_data[m_offset + 1];
+          uint8_t BRZ = m_data[m_offset + 2];
+          m_group.m_B = (BRZ & 0x80) >> 7;
+          m_group.m_reserved = (BRZ & 0x7e) >> 1;
+          m_group.m_Z = (BRZ & 0x01);
+          m_group.m_maskLength = m_data[m_offset + 3];
+          m_group.m_groupAddress = Ipv4Address(ReadU32(m_offset + 4));
+          m_offset += PIM_DM_ENC_GRP;
+          m_joinsLeft = ReadU16(m_offset);
+          m_prunesLeft = ReadU16(m_offset + 2);
+          m_offset += 4;
+        }
+      if (m_offset + PIM_DM_ENC_SRC > m_size)
+        return false;
+      m_join = m_joinsLeft > 0;
+      if (m_join)
+        m_joinsLeft--;
+      else
+        m_prunesLeft--;
+      m_source.m_addressFamily = m_data[m_offset];
+      m_source.m_encodingType = m_data[m_offset + 1];
+      uint8_t RSWR = m_data[m_offset + 2];
+      m_source.m_reserved = (RSWR & 0xf8) >> 3;
+      m_source.m_S = (RSWR & 0x04) >> 2;
+      m_source.m_W = (RSWR & 0x02) >> 1;
+      m_source.m_R = (RSWR & 0x01);
+      m_source.m_maskLength = m_data[m_offset + 3];
+      m_source.m_sourceAddress = Ipv4Address(ReadU32(m_offset + 4));
+      m_offset += PIM_DM_ENC_SRC;
+      return true;
+    }
+
+    uint16_t
+    JoinPruneGraftView::ReadU16 (uint32_t offset) const
+    {
+      return m_data[offset] << 8 | m_data[offset + 1];
+    }
+
+    uint32_t
+    JoinPruneGraftView::ReadU32 (uint32_t offset) const
+    {
+      return (uint32_t) ReadU16(offset) << 16 | ReadU16(offset + 2);
+    }
+
   } // namespace pimdm
 } // namespace ns3
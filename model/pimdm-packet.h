@@ -38,6 +38,8 @@
 #include <ns3/ipv4-address.h>
 #include <ns3/enum.h>
 #include <ns3/nstime.h>
+#include <ns3/ptr.h>
+#include <ns3/simple-ref-count.h>
 
 const uint32_t PIM_NATIVE_ENCODING = 0;		///< PIM native encoding.
 const uint32_t PIM_DM_HEADER_SIZE = 4;  	///< PIM header size in bytes.
@@ -52,6 +54,8 @@ const uint32_t PIM_DM_HELLO_STATEREFRESH = 4;	///< PIM state refresh size in byt
 const uint32_t PIM_DM_JPG = (PIM_DM_ENC_UNI + 4);	///< PIM join-prune-graft message size in bytes.
 const uint32_t PIM_DM_ASSERT = (PIM_DM_ENC_GRP + PIM_DM_ENC_UNI + 8 + 4);	///< PIM assert message size in bytes.
 const uint32_t PIM_DM_REFRESH = (PIM_DM_ENC_GRP + PIM_DM_ENC_UNI + PIM_DM_ENC_UNI + 24);///< PIM refresh message size in bytes.
+const uint32_t PIM_DM_REFRESH_TTL = (PIM_DM_HEADER_SIZE + PIM_DM_ENC_GRP + 2 * PIM_DM_ENC_UNI + 9);	///< Offset of the TTL in a serialized PIM refresh message, the flags follow.
+const uint32_t PIM_DM_REFRESH_PAD = 12;	///< Zero bytes closing a PIM refresh message, counted in PIM_DM_REFRESH.
 const uint32_t PIM_IP_PROTOCOL_NUM = 103; ///< PIM IP Protocol number defined by IANA. http://www.iana.org/assignments/protocol-numbers/protocol-numbers.xml
 
 namespace ns3
@@ -75,6 +79,88 @@ namespace ns3
       PIM_STATE_REF = 9,
     };
 
+    /// \brief Buffer::Iterator that adds every byte written or read through it to the PIM checksum.
+    ///
+    /// The message body is (de)serialized once: the one's complement sum is kept as bytes go by,
+    /// instead of walking the buffer again with Buffer::Iterator::CalculateIpChecksum.
+    class ChecksumIterator
+    {
+      public:
+        ChecksumIterator (Buffer::Iterator i) :
+            m_iter(i), m_sum(0), m_odd(false)
+        {
+        }
+
+        void
+        WriteU8 (uint8_t data)
+        {
+          m_iter.WriteU8(data);
+          Add(data);
+        }
+        void
+        WriteHtonU16 (uint16_t data)
+        {
+          m_iter.WriteHtonU16(data);
+          Add(data >> 8);
+          Add(data & 0xff);
+        }
+        void
+        WriteHtonU32 (uint32_t data)
+        {
+          WriteHtonU16(data >> 16);
+          WriteHtonU16(data & 0xffff);
+        }
+        uint8_t
+        ReadU8 ()
+        {
+          uint8_t data = m_iter.ReadU8();
+          Add(data);
+          return data;
+        }
+        uint16_t
+        ReadNtohU16 ()
+        {
+          uint16_t data = m_iter.ReadNtohU16();
+          Add(data >> 8);
+          Add(data & 0xff);
+          return data;
+        }
+        uint32_t
+        ReadNtohU32 ()
+        {
+          uint32_t data = ReadNtohU16();
+          return data << 16 | ReadNtohU16();
+        }
+        uint32_t
+        GetSize () const
+        {
+          return m_iter.GetSize();
+        }
+        /// \return The checksum of the bytes seen so far, with the byte order of
+        ///   Buffer::Iterator::CalculateIpChecksum, which sums words read low byte first.
+        uint16_t
+        GetChecksum () const
+        {
+          uint32_t sum = m_sum;
+          while (sum >> 16)
+            sum = (sum & 0xffff) + (sum >> 16);
+          uint16_t checksum = ~sum;
+          return checksum << 8 | checksum >> 8;
+        }
+
+      private:
+        void
+        Add (uint8_t data)
+        {
+          m_sum += m_odd ? data : data << 8;
+          m_odd = !m_odd;
+        }
+
+        Buffer::Iterator m_iter;
+        uint32_t m_sum;  ///< big-endian sum of the 16-bit words seen so far
+        bool m_odd;      ///< the next byte is the low one of its word
+    };
+
     /**
      * \ingroup PIM-DM.
      *
@@ -220,9 +306,9 @@ namespace ns3
             uint32_t
             GetSerializedSize (void) const;
             void
-            Serialize (Buffer::Iterator start) const;
+            Serialize (ChecksumIterator &i) const;
             uint32_t
-            Deserialize (Buffer::Iterator start, uint32_t messageSize);
+            Deserialize (ChecksumIterator &i, uint32_t messageSize);
         };
 
 //	An Encoded Group address has the following format:
@@ -272,9 +358,9 @@ namespace ns3
             uint32_t
             GetSerializedSize (void) const;
             void
-            Serialize (Buffer::Iterator start) const;
+            Serialize (ChecksumIterator &i) const;
             uint32_t
-            Deserialize (Buffer::Iterator start, uint32_t messageSize);
+            Deserialize (ChecksumIterator &i, uint32_t messageSize);
         };
 
 //	0               1               2               3
@@ -322,9 +408,9 @@ namespace ns3
             uint32_t
             GetSerializedSize (void) const;
             void
-            Serialize (Buffer::Iterator start) const;
+            Serialize (ChecksumIterator &i) const;
             uint32_t
-            Deserialize (Buffer::Iterator start, uint32_t messageSize);
+            Deserialize (ChecksumIterator &i, uint32_t messageSize);
         };
 
 //	0               1               2               3
@@ -494,9 +580,9 @@ namespace ns3
             uint32_t
             GetSerializedSize (void) const;
             void
-            Serialize (Buffer::Iterator start) const;
+            Serialize (ChecksumIterator &i) const;
             uint32_t
-            Deserialize (Buffer::Iterator start, uint32_t messageSize);
+            Deserialize (ChecksumIterator &i, uint32_t messageSize);
         };
 
 //	0               1               2               3
@@ -559,9 +645,9 @@ namespace ns3
             uint32_t
             GetSerializedSize (void) const;
             void
-            Serialize (Buffer::Iterator start) const;
+            Serialize (ChecksumIterator &i) const;
             uint32_t
-            Deserialize (Buffer::Iterator start, uint32_t messageSize);
+            Deserialize (ChecksumIterator &i, uint32_t messageSize);
         };
 
 //	0               1               2               3
@@ -597,9 +683,9 @@ namespace ns3
             uint32_t
             GetSerializedSize (void) const;
             void
-            Serialize (Buffer::Iterator start) const;
+            Serialize (ChecksumIterator &i) const;
             uint32_t
-            Deserialize (Buffer::Iterator start, uint32_t messageSize);
+            Deserialize (ChecksumIterator &i, uint32_t messageSize);
         };
 
 //	0               1               2               3
@@ -666,9 +752,9 @@ namespace ns3
             uint32_t
             GetSerializedSize (void) const;
             void
-            Serialize (Buffer::Iterator start) const;
+            Serialize (ChecksumIterator &i) const;
             uint32_t
-            Deserialize (Buffer::Iterator start, uint32_t messageSize);
+            Deserialize (ChecksumIterator &i, uint32_t messageSize);
         };
 
 //	PIM Graft messages use the same format as Join/Prune messages, except
@@ -688,9 +774,9 @@ namespace ns3
             uint32_t
             GetSerializedSize (void) const;
             void
-            Serialize (Buffer::Iterator start) const;
+            Serialize (ChecksumIterator &i) const;
             uint32_t
-            Deserialize (Buffer::Iterator start, uint32_t messageSize);
+            Deserialize (ChecksumIterator &i, uint32_t messageSize);
         };
 //	PIM Graft Ack messages are identical in format to the received Graft
 //	  message, except that the Type field is set to 7.  The Upstream
@@ -709,9 +795,9 @@ namespace ns3
             uint32_t
             GetSerializedSize (void) const;
             void
-            Serialize (Buffer::Iterator start) const;
+            Serialize (ChecksumIterator &i) const;
             uint32_t
-            Deserialize (Buffer::Iterator start, uint32_t messageSize);
+            Deserialize (ChecksumIterator &i, uint32_t messageSize);
         };
 
 //	0               1               2               3
@@ -754,9 +840,9 @@ namespace ns3
             uint32_t
             GetSerializedSize (void) const;
             void
-            Serialize (Buffer::Iterator start) const;
+            Serialize (ChecksumIterator &i) const;
             uint32_t
-            Deserialize (Buffer::Iterator start, uint32_t messageSize);
+            Deserialize (ChecksumIterator &i, uint32_t messageSize);
         };
 
 //	0               1               2               3
@@ -834,108 +920,123 @@ namespace ns3
             uint32_t
             GetSerializedSize (void) const;
             void
-            Serialize (Buffer::Iterator start) const;
+            Serialize (ChecksumIterator &i) const;
             uint32_t
-            Deserialize (Buffer::Iterator start, uint32_t messageSize);
+            Deserialize (ChecksumIterator &i, uint32_t messageSize);
         };
 
       private:
-        struct
+        /// Body of the active message. Copies of the header share it until one of them asks for a modifiable body.
+        struct MessageBody : public SimpleRefCount<MessageBody>
         {
-            HelloMessage hello;
-            JoinPruneMessage joinPrune;
-            AssertMessage assert;
-            GraftMessage graft;
-            GraftAckMessage graftAck;
-            StateRefreshMessage stateRefresh;
-        } m_pim_message;
+            PIMType type; ///< type of the message held
+            MessageBody (PIMType t) :
+                type(t)
+            {
+            }
+            virtual
+            ~MessageBody ()
+            {
+            }
+            virtual MessageBody*
+            Clone () const = 0;
+        };
+
+        template<typename T>
+          struct MessageHolder : public MessageBody
+          {
+              T message;
+              MessageHolder (PIMType t) :
+                  MessageBody(t)
+              {
+              }
+              virtual MessageBody*
+              Clone () const
+              {
+                return new MessageHolder<T>(*this);
+              }
+          };
+
+        Ptr<MessageBody> m_body; ///< null until the body is first accessed
+
+        /// \brief Body of the given type, created on first use and unshared before it is returned.
+        template<typename T>
+          T&
+          GetBody (PIMType type)
+          {
+            if (m_type == 0)
+              {
+                m_type = type;
+              }
+            else
+              {
+                NS_ASSERT(m_type == type);
+              }
+            if (!m_body || m_body->type != type)
+              m_body = Ptr<MessageBody>(new MessageHolder<T>(type), false);
+            else if (m_body->GetReferenceCount() > 1)
+              m_body = Ptr<MessageBody>(m_body->Clone(), false);
+            return static_cast<MessageHolder<T>*>(PeekPointer(m_body))->message;
+          }
+
+        /// \brief Body of the given type for reading, an empty message if none was set.
+        template<typename T>
+          const T&
+          PeekBody (PIMType type) const
+          {
+            static const T empty = T();
+            if (!m_body || m_body->type != type)
+              return empty;
+            return static_cast<const MessageHolder<T>*>(PeekPointer(m_body))->message;
+          }
 
       public:
 
         HelloMessage&
         GetHelloMessage ()
         {
-          if (m_type == 0)
-            {
-              m_type = PIM_HELLO;
-            }
-          else
-            {
-              NS_ASSERT(m_type == PIM_HELLO);
-            }
-          return m_pim_message.hello;
+          return GetBody<HelloMessage>(PIM_HELLO);
         }
 
         JoinPruneMessage&
         GetJoinPruneMessage ()
         {
-          if (m_type == 0)
-            {
-              m_type = PIM_JP;
-            }
-          else
-            {
-              NS_ASSERT(m_type == PIM_JP);
-            }
-          return m_pim_message.joinPrune;
+          return GetBody<JoinPruneMessage>(PIM_JP);
         }
 
         AssertMessage&
         GetAssertMessage ()
         {
-          if (m_type == 0)
-            {
-              m_type = PIM_ASSERT;
-            }
-          else
-            {
-              NS_ASSERT(m_type == PIM_ASSERT);
-            }
-          return m_pim_message.assert;
+          return GetBody<AssertMessage>(PIM_ASSERT);
         }
 
         GraftMessage&
         GetGraftMessage ()
         {
-          if (m_type == 0)
-            {
-              m_type = PIM_GRAFT;
-            }
-          else
-            {
-              NS_ASSERT(m_type == PIM_GRAFT);
-            }
-          return m_pim_message.graft;
+          return GetBody<GraftMessage>(PIM_GRAFT);
         }
 
         GraftAckMessage&
         GetGraftAckMessage ()
         {
-          if (m_type == 0)
-            {
-              m_type = PIM_GRAFT_ACK;
-            }
-          else
-            {
-              NS_ASSERT(m_type == PIM_GRAFT_ACK);
-            }
-          return m_pim_message.graftAck;
+          return GetBody<GraftAckMessage>(PIM_GRAFT_ACK);
         }
 
         StateRefreshMessage&
         GetStateRefreshMessage ()
         {
-          if (m_type == 0)
-            {
-              m_type = PIM_STATE_REF;
-            }
-          else
-            {
-              NS_ASSERT(m_type == PIM_STATE_REF);
-            }
-          return m_pim_message.stateRefresh;
+          return GetBody<StateRefreshMessage>(PIM_STATE_REF);
         }
 
+        /// \brief Set TTL and flags of a serialized State Refresh message to those of refresh, updating its checksum.
+        ///
+        /// Only the 16-bit word holding each changed byte enters the checksum update (RFC 1624, eqn. 3).
+        static void
+        PatchStateRefresh (std::vector<uint8_t> &bytes, const StateRefreshMessage &refresh);
+        /// \brief Set a byte of a serialized PIM message, updating its checksum.
+        static void
+        PatchByte (std::vector<uint8_t> &bytes, uint32_t offset, uint8_t value);
+
     };
 
     static inline std::ostream&
@@ -945,6 +1046,65 @@ namespace ns3
       return os;
     }
 
+    /// \brief Read-only view of a serialized Join/Prune, Graft or Graft Ack message, PIM header included.
+    ///
+    /// The (group, source) pairs are decoded one at a time from the bytes of the message, without building
+    /// the MulticastGroupEntry lists of PIMHeader: joined sources of a group come first, then pruned ones.
+    class JoinPruneGraftView
+    {
+      public:
+        JoinPruneGraftView (const uint8_t *data, uint32_t size);
+
+        PIMType
+        GetType () const
+        {
+          return PIMType(m_data[0] & 0x0f);
+        }
+        /// Upstream neighbor, number of groups and hold time of the message.
+        const PIMHeader::JoinPruneGraftMessage&
+        GetMessage () const
+        {
+          return m_message;
+        }
+        /// \brief Move to the next (group, source) pair.
+        /// \return False when no pair is left or the message is truncated.
+        bool
+        Next ();
+        const PIMHeader::EncodedGroup&
+        GetGroup () const
+        {
+          return m_group;
+        }
+        const PIMHeader::EncodedSource&
+        GetSource () const
+        {
+          return m_source;
+        }
+        /// True if the current source is joined, false if it is pruned.
+        bool
+        IsJoin () const
+        {
+          return m_join;
+        }
+
+      private:
+        uint16_t
+        ReadU16 (uint32_t offset) const;
+        uint32_t
+        ReadU32 (uint32_t offset) const;
+
+        const uint8_t *m_data;     ///< message bytes, owned by the caller
+        uint32_t m_size;           ///< message size
+        uint32_t m_offset;         ///< next byte to decode
+        uint8_t m_groupsLeft;      ///< group entries not decoded yet
+        uint16_t m_joinsLeft;      ///< joined sources left in the current group
+        uint16_t m_prunesLeft;     ///< pruned sources left in the current group
+        bool m_join;               ///< the current source is joined
+        PIMHeader::JoinPruneGraftMessage m_message;
+        PIMHeader::EncodedGroup m_group;
+        PIMHeader::EncodedSource m_source;
+    };
+
     typedef std::vector<PIMHeader> PIMMessageList;
 
     static inline std::ostream&
@@ -63,16 +63,22 @@ namespace ns3
     MulticastRoutingProtocol::MulticastRoutingProtocol () :
         m_mainInterface(0), m_mainAddress(Ipv4Address()), m_hostInterface(0), m_hostAddress(Ipv4Address()),
         m_helloHoldTime(0), m_generationID(0), m_startTime(0), m_stopTx(false), m_routingTableAssociation(0), m_ipv4(0),
-        m_identification(0), m_routingProtocol(0), m_lo(0), m_rpfChecker(Timer::CANCEL_ON_DESTROY)
+        m_identification(0), m_routingProtocol(0), m_lo(0), m_rpfChecker(Timer::CANCEL_ON_DESTROY),
+        m_helloTimer(Timer::CANCEL_ON_DESTROY), m_helloSuppression(false), m_started(false), m_pruneAck(false), m_densityAwareOverride(false),
+        m_graftRetryAdaptive(true), m_sharedMediumTib(false), m_nativeForwarding(false),
+        m_unicastRelayThreshold(0), m_duplicateCacheSize(0), m_densityJitter(false), m_controlPriority(false), m_controlTos(0), m_controlQueue(false), m_policerBurst(0), m_policerDrops(0),
+        m_admitted(false),
+        m_routeProbeRetries(RouteProbe_MaxRetry), m_routeProbeQueueLen(RouteProbe_QueueLen)
     {
       m_RoutingTable = Create<Ipv4StaticRouting>();
       m_IfaceNeighbors.clear();
       m_IfaceSourceGroup.clear();
       m_LocalReceiver.clear();
-      m_IfacePimEnabled.clear();
+      m_interfaces.clear();
       m_mrib.clear();
       m_interfaceExclusions.clear();
       m_socketAddresses.clear();
+      m_pendingRoutes.clear();
     }
 
     MulticastRoutingProtocol::~MulticastRoutingProtocol ()
@@ -89,6 +95,11 @@ MulticastRoutingProtocol::GetTypeId (void)
                    TimeValue (Seconds (Hello_Period)),
                    MakeTimeAccessor (&MulticastRoutingProtocol::m_helloTime),
                    MakeTimeChecker ())
+        .AddAttribute ("HelloSuppression", "Skip periodic Hellos on interfaces where other control messages recently refreshed the neighbors. "
+                   "Neighbors must have it enabled too, as they refresh the liveness timer on any control message.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&MulticastRoutingProtocol::m_helloSuppression),
+                   MakeBooleanChecker ())
         .AddAttribute ("HelloHoldTime", "HoldTime used in hello messages.",
                    UintegerValue (Hold_Time_Default),
                    MakeUintegerAccessor (&MulticastRoutingProtocol::SetHelloHoldTime),
@@ -105,6 +116,105 @@ MulticastRoutingProtocol::GetTypeId (void)
                    TimeValue (Seconds (Propagation_Delay)),
                    MakeTimeAccessor (&MulticastRoutingProtocol::m_LanDelay),
                    MakeTimeChecker ())
+        .AddAttribute ("PruneAck", "Acknowledged prune mode: Prunes are acknowledged by the upstream router and retransmitted until then. "
+                   "All the routers on the link must enable it.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&MulticastRoutingProtocol::m_pruneAck),
+                   MakeBooleanChecker ())
+        .AddAttribute ("PruneRetryPeriod", "Prune retransmission timeout in acknowledged prune mode.",
+                   TimeValue (Seconds (Prune_Retry_Period)),
+                   MakeTimeAccessor (&MulticastRoutingProtocol::m_pruneRetryPeriod),
+                   MakeTimeChecker ())
+        .AddAttribute ("DensityAwareOverride", "Scale the prune override window with the number of neighbors; "
+                   "the prune pending timer keeps the full J/P_Override_Interval.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&MulticastRoutingProtocol::m_densityAwareOverride),
+                   MakeBooleanChecker ())
+        .AddAttribute ("GraftRetryAdaptive", "Set the Graft Retry Timer from the measured Graft/GraftAck round trip time, "
+                   "bounded by Graft_Retry_Period.",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&MulticastRoutingProtocol::m_graftRetryAdaptive),
+                   MakeBooleanChecker ())
+        .AddAttribute ("SharedMediumState", "Keep a single (S,G) entry per multi-access interface, "
+                   "recording the pruning neighbors instead of one entry per neighbor.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&MulticastRoutingProtocol::m_sharedMediumTib),
+                   MakeBooleanChecker ())
+        .AddAttribute ("NativeForwarding", "Forward data packets at the IP layer through the resolved multicast routes, "
+                   "instead of relaying them through the PIM sockets; the input link is still served by relay.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&MulticastRoutingProtocol::m_nativeForwarding),
+                   MakeBooleanChecker ())
+        .AddAttribute ("UnicastRelayThreshold", "Relay data by unicast to each downstream neighbor when an interface "
+                   "has at most this many of them and no local members, by broadcast otherwise (0: always broadcast).",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&MulticastRoutingProtocol::m_unicastRelayThreshold),
+                   MakeUintegerChecker<uint32_t> ())
+        .AddAttribute ("DuplicateCacheSize", "Data packets remembered to drop the copies relayed by other neighbors "
+                   "(0: no duplicate suppression).",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&MulticastRoutingProtocol::m_duplicateCacheSize),
+                   MakeUintegerChecker<uint32_t> ())
+        .AddAttribute ("DuplicateCacheLifetime", "Time a data packet is remembered by the duplicate cache.",
+                   TimeValue (Seconds (Duplicate_Lifetime)),
+                   MakeTimeAccessor (&MulticastRoutingProtocol::m_duplicateLifetime),
+                   MakeTimeChecker ())
+        .AddAttribute ("DensityAwareJitter", "Size the random delay of relayed data and control messages "
+                   "by one slot for each neighbor on the outgoing interface: narrower on sparse links, wider on dense ones.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&MulticastRoutingProtocol::m_densityJitter),
+                   MakeBooleanChecker ())
+        .AddAttribute ("JitterSlot", "Jitter window of relayed data per neighbor when DensityAwareJitter is enabled.",
+                   TimeValue (MicroSeconds (25)),
+                   MakeTimeAccessor (&MulticastRoutingProtocol::m_jitterSlot),
+                   MakeTimeChecker ())
+        .AddAttribute ("ControlJitterSlot", "Jitter window of control messages per neighbor when DensityAwareJitter is enabled.",
+                   TimeValue (MicroSeconds (250)),
+                   MakeTimeAccessor (&MulticastRoutingProtocol::m_controlJitterSlot),
+                   MakeTimeChecker ())
+        .AddAttribute ("JitterMax", "Upper bound of the jitter window when DensityAwareJitter is enabled.",
+                   TimeValue (MilliSeconds (10)),
+                   MakeTimeAccessor (&MulticastRoutingProtocol::m_jitterMax),
+                   MakeTimeChecker ())
+        .AddAttribute ("ControlPriority", "Hold relayed data on an interface until the control messages "
+                   "scheduled on it have been sent.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&MulticastRoutingProtocol::m_controlPriority),
+                   MakeBooleanChecker ())
+        .AddAttribute ("ControlTos", "Type of service of PIM control messages, e.g. 192 for DSCP CS6 (network control).",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&MulticastRoutingProtocol::m_controlTos),
+                   MakeUintegerChecker<uint8_t> ())
+        .AddAttribute ("ControlQueue", "Queue control messages per interface, dropping identical pending ones, "
+                   "and send them from a single event.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&MulticastRoutingProtocol::m_controlQueue),
+                   MakeBooleanChecker ())
+        .AddAttribute ("ControlPacing", "Minimum time between two queued control messages on an interface "
+                   "(0: the queue is sent at once).",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&MulticastRoutingProtocol::m_controlPacing),
+                   MakeTimeChecker ())
+        .AddAttribute ("PolicerRate", "Rate of data accepted per (S,G) on each input interface (0: no policer).",
+                   DataRateValue (DataRate ("0bps")),
+                   MakeDataRateAccessor (&MulticastRoutingProtocol::m_policerRate),
+                   MakeDataRateChecker ())
+        .AddAttribute ("PolicerBurst", "Bytes of data accepted back to back per (S,G) on each input interface.",
+                   UintegerValue (15000),
+                   MakeUintegerAccessor (&MulticastRoutingProtocol::m_policerBurst),
+                   MakeUintegerChecker<uint32_t> ())
+        .AddAttribute ("RouteProbeBackoff", "Initial back-off between two route probes towards the same destination.",
+                   TimeValue (Seconds (RouteProbe_Backoff)),
+                   MakeTimeAccessor (&MulticastRoutingProtocol::m_routeProbeBackoff),
+                   MakeTimeChecker ())
+        .AddAttribute ("RouteProbeRetries", "Route probes sent towards a destination before giving up.",
+                   UintegerValue (RouteProbe_MaxRetry),
+                   MakeUintegerAccessor (&MulticastRoutingProtocol::m_routeProbeRetries),
+                   MakeUintegerChecker<uint32_t> ())
+        .AddAttribute ("RouteProbeQueueLen", "Data packets held per destination while its route is looked up.",
+                   UintegerValue (RouteProbe_QueueLen),
+                   MakeUintegerAccessor (&MulticastRoutingProtocol::m_routeProbeQueueLen),
+                   MakeUintegerChecker<uint32_t> ())
 	.AddTraceSource ("PimRxControl", "Trace PIM packet received.",
                          MakeTraceSourceAccessor (&MulticastRoutingProtocol::m_rxControlPacketTrace))
 	.AddTraceSource ("PimTxControl", "Trace PIM packet sent.",
@@ -113,6 +223,8 @@ MulticastRoutingProtocol::GetTypeId (void)
                          MakeTraceSourceAccessor (&MulticastRoutingProtocol::m_rxDataPacketTrace))
         .AddTraceSource ("PimTxData", "Trace data packet sent.",
                          MakeTraceSourceAccessor (&MulticastRoutingProtocol::m_txDataPacketTrace))
+        .AddTraceSource ("PimPolicerDrop", "Trace data packet dropped by the ingress policer.",
+                         MakeTraceSourceAccessor (&MulticastRoutingProtocol::m_policerDropTrace))
 	.AddTraceSource ("PimRouteTxControl", "Trace route control packets.",
                          MakeTraceSourceAccessor (&MulticastRoutingProtocol::m_txControlRouteTrace))
 	.AddTraceSource ("RoutingTableChanged", "The PIM-DM routing table has changed.",
@@ -227,28 +339,28 @@ MulticastRoutingProtocol::GetTypeId (void)
       NS_LOG_DEBUG("Main Addr = "<< m_mainAddress << ": Group "<<group<<" #Source: "<< sources);
       if (group == Ipv4Address(ALL_PIM_ROUTERS4) || sources > 1)
         return;	//Socket already registered for this group
+      m_dataGroups.insert(group);
       for (uint32_t i = 0; i < m_ipv4->GetNInterfaces(); i++)
         {
-          if (IsLoopInterface(i))
+          if (IsLoopInterface(i) || IsExcluded(i))
             continue;
-          ///Registering endpoint for that address... by creating a socket to listen only on this interface
+          InterfaceState &ifs = InsertInterfaceState(i);
+          if (ifs.dataSocket)
+            continue;
+          ///Registering endpoint for the data... one socket per interface, groups are demultiplexed in RecvMessage
           Ptr<Socket> socketG = Socket::CreateSocket(GetObject<Node>(), Ipv4RawSocketFactory::GetTypeId());
           socketG->SetAttribute("Protocol", UintegerValue(UdpL4Protocol::PROT_NUMBER));
           socketG->SetAttribute("IpHeaderInclude", BooleanValue(true));
           socketG->SetAllowBroadcast(true);
-          //	InetSocketAddress inetAddr (group, PIM_PORT_NUMBER);
-          InetSocketAddress inetAddr(group);
+          InetSocketAddress inetAddr(Ipv4Address::GetAny());
           socketG->SetRecvCallback(MakeCallback(&MulticastRoutingProtocol::RecvMessage, this));
           if (socketG->Bind(inetAddr))
             {
-              NS_FATAL_ERROR("Failed to bind() PIMDM socket for group "<<group);
+              NS_FATAL_ERROR("Failed to bind() PIMDM data socket on interface "<<i);
             }
           socketG->BindToNetDevice(m_ipv4->GetNetDevice(i));
-          m_socketAddresses[socketG] = m_ipv4->GetAddress(i, 0); //PROBLEM; does not broadcast on local IP, takes the other group-interface
-          NS_LOG_DEBUG("Registering Group Socket = "<<socketG<< " Device = "<<socketG->GetBoundNetDevice()<< ", SocketAddr = "<<m_ipv4->GetAddress (i, 0).GetLocal() <<", I = "<<i);
-          Ipv4InterfaceAddress mgroup(group, Ipv4Mask::GetOnes());	// WIFI OK
-          m_socketAddresses[socketG] = mgroup;						// WIFI OK
-          NS_LOG_DEBUG("Group Socket "<<socketG << " Addr: "<<group<<":AnyPort");
+          ifs.dataSocket = socketG;
+          NS_LOG_DEBUG("Registering Data Socket = "<<socketG<< " Device = "<<socketG->GetBoundNetDevice()<<", I = "<<i);
         }
     }
 
@@ -260,6 +372,7 @@ MulticastRoutingProtocol::GetTypeId (void)
     {
       NS_LOG_FUNCTION_NOARGS ();
       m_mrib.clear();
+      m_outputRoutes.clear();
     }
 
     uint32_t
@@ -277,6 +390,7 @@ MulticastRoutingProtocol::GetTypeId (void)
     {
       NS_LOG_FUNCTION(this);
       m_mrib.erase(group);
+      m_outputRoutes.clear();
     }
 
     void
@@ -414,17 +528,17 @@ MulticastRoutingProtocol::GetTypeId (void)
           NS_LOG_DEBUG ("No PIMDM interfaces");
           return rtentry;
         }
-      RoutingMulticastTable entry1;
-      bool found = Lookup(header.GetDestination(), entry1);
+      bool found = false;
       if (header.GetDestination().IsMulticast())
         {  //entry in the routing table found
           uint32_t interfaceIdx = UINT_MAX;
+          std::map<Ipv4Address, RoutingMulticastTable>::const_iterator entry1;
           if (oif != NULL)  //we are sending on a specific device, so we "want" to use that interface
             interfaceIdx = m_ipv4->GetInterfaceForDevice(oif);  //
           else if (IsMyOwnAddress(header.GetSource())) //since we deal with multicast packet, and the interface is null...this might be the source
             interfaceIdx = m_ipv4->GetInterfaceForAddress(header.GetSource());
-          else if (Lookup(header.GetDestination(), entry1)) //we don't know anything :( looking for the first entry for this group;
-            interfaceIdx = entry1.mgroup.begin()->second.interface;
+          else if ((entry1 = m_mrib.find(header.GetDestination())) != m_mrib.end() && !entry1->second.mgroup.empty()) //we don't know anything :( looking for the first entry for this group;
+            interfaceIdx = entry1->second.mgroup.begin()->second.interface;
           if ((oif && m_ipv4->GetInterfaceForDevice(oif) != static_cast<int>(interfaceIdx)) || interfaceIdx == UINT_MAX)
             {
               // We do not attempt to perform a constrained routing search
@@ -439,26 +553,18 @@ MulticastRoutingProtocol::GetTypeId (void)
               return rtentry;
             }
           sockerr = Socket::ERROR_NOTERROR;
-          rtentry = Create<Ipv4Route>();
-          rtentry->SetDestination(header.GetDestination());
-          // the source address is the interface address that matches
-          // the destination address (when multiple are present on the
-          // outgoing interface, one is selected via scoping rules)
-          NS_ASSERT(m_ipv4);
-          uint32_t numOifAddresses = m_ipv4->GetNAddresses(interfaceIdx);
-          NS_ASSERT(numOifAddresses > 0);
-          Ipv4InterfaceAddress ifAddr;
-          if (numOifAddresses == 1)
-            {
-              ifAddr = m_ipv4->GetAddress(interfaceIdx, 0);
-            }
-          else
-            {
-              NS_FATAL_ERROR("TODO Not implemented yet:  IP aliasing");
+          rtentry = GetOutputRoute(header.GetDestination(), interfaceIdx);
+          RelayTag relayTag;
+          if (p && p->PeekPacketTag(relayTag) && relayTag.m_receiver != m_ipv4->GetAddress(interfaceIdx, 0).GetBroadcast()
+              && !relayTag.m_receiver.IsBroadcast() && !relayTag.m_receiver.IsMulticast())
+            { // unicast relay: link-layer delivery to the downstream neighbor, on a private copy of the shared route
+              Ptr<Ipv4Route> relay = Create<Ipv4Route>();
+              relay->SetDestination(rtentry->GetDestination());
+              relay->SetSource(rtentry->GetSource());
+              relay->SetOutputDevice(rtentry->GetOutputDevice());
+              relay->SetGateway(relayTag.m_receiver);
+              rtentry = relay;
             }
-          rtentry->SetSource(ifAddr.GetLocal());
-          rtentry->SetOutputDevice(m_ipv4->GetNetDevice(interfaceIdx));
-          rtentry->SetGateway(header.GetDestination());
           NS_LOG_DEBUG ("PIM-DM node " << m_mainAddress << ": RouteOutput for dest= " << header.GetDestination () << " gateway= "<< rtentry->GetGateway () << ", interface = " << interfaceIdx);
           found = true;
         }
@@ -471,6 +577,37 @@ MulticastRoutingProtocol::GetTypeId (void)
       return rtentry;
     }
 
+    Ptr<Ipv4Route>
+    MulticastRoutingProtocol::GetOutputRoute (Ipv4Address group, uint32_t interface)
+    {
+      std::pair<Ipv4Address, uint32_t> key(group, interface);
+      std::map<std::pair<Ipv4Address, uint32_t>, Ptr<Ipv4Route> >::const_iterator cached = m_outputRoutes.find(key);
+      if (cached != m_outputRoutes.end())
+        return cached->second;
+      Ptr<Ipv4Route> rtentry = Create<Ipv4Route>();
+      rtentry->SetDestination(group);
+      // the source address is the interface address that matches
+      // the destination address (when multiple are present on the
+      // outgoing interface, one is selected via scoping rules)
+      NS_ASSERT(m_ipv4);
+      uint32_t numOifAddresses = m_ipv4->GetNAddresses(interface);
+      NS_ASSERT(numOifAddresses > 0);
+      Ipv4InterfaceAddress ifAddr;
+      if (numOifAddresses == 1)
+        {
+          ifAddr = m_ipv4->GetAddress(interface, 0);
+        }
+      else
+        {
+          NS_FATAL_ERROR("TODO Not implemented yet:  IP aliasing");
+        }
+      rtentry->SetSource(ifAddr.GetLocal());
+      rtentry->SetOutputDevice(m_ipv4->GetNetDevice(interface));
+      rtentry->SetGateway(group);
+      m_outputRoutes[key] = rtentry;
+      return rtentry;
+    }
+
     bool
     MulticastRoutingProtocol::RouteInput (Ptr<const Packet> p, const Ipv4Header &header, Ptr<const NetDevice> idev,
                                           UnicastForwardCallback ucb, MulticastForwardCallback mcb,
@@ -487,9 +624,34 @@ MulticastRoutingProtocol::GetTypeId (void)
           return false;
         }
 
-      // Local delivery
       NS_ASSERT(m_ipv4->GetInterfaceForDevice (idev) >= 0);
       uint32_t iif = m_ipv4->GetInterfaceForDevice(idev);
+      // Native forwarding: the data socket has already run the (S,G) state machines and refreshed the route
+      bool forwarded = false;
+      if (m_nativeForwarding && dst.IsMulticast() && !mcb.IsNull())
+        {
+          std::map<SourceGroupPair, Ptr<Ipv4MulticastRoute> >::const_iterator route = m_nativeRoutes.find(
+              SourceGroupPair(origin, dst));
+          if (route != m_nativeRoutes.end() && route->second->GetParent() == iif)
+            {
+              // the data socket has run RecvPIMData on this packet already: honor its admission verdict,
+              // admit here only the packets it did not get to
+              std::pair<DataPacketId, uint32_t> key(DataPacketId(route->first, header.GetIdentification()), iif);
+              bool admitted = (key == m_admission ? m_admitted
+                  : AdmitData(route->first, header.GetIdentification(), iif, p, p->GetSize() + header.GetSerializedSize()));
+              m_admission.second = 0; // taken
+              if (!admitted)
+                return true;
+              Ptr<Packet> fwd = p->Copy();
+              RelayTag relayTag;
+              fwd->RemovePacketTag(relayTag); // the relay tag names the previous hop only
+              NS_LOG_DEBUG ("Native forwarding of "<< origin <<","<< dst <<" from interface "<< iif);
+              mcb(route->second, fwd, header);
+              forwarded = true;
+            }
+        }
+
+      // Local delivery
       if (m_ipv4->IsDestinationAddress(dst, iif))
         {
           if (!lcb.IsNull())
@@ -507,7 +669,7 @@ MulticastRoutingProtocol::GetTypeId (void)
               // packet, and invoke the error callback if so
 
               //TODO implement here the callback
-              return false;
+              return forwarded;
             }
         }
       if (m_RoutingTable->RouteInput(p, header, idev, ucb, mcb, lcb, ecb))
@@ -573,6 +735,7 @@ MulticastRoutingProtocol::GetTypeId (void)
     MulticastRoutingProtocol::NotifyInterfaceDown (uint32_t i)
     {
       NS_LOG_FUNCTION(this << i);
+      m_outputRoutes.clear();
       DisablePimInterface(i);
     }
 
@@ -581,8 +744,17 @@ MulticastRoutingProtocol::GetTypeId (void)
     {
       NS_LOG_FUNCTION(this << GetObject<Node> ()->GetId());
       Ipv4Address addr = m_ipv4->GetAddress(i, 0).GetLocal();
+      m_outputRoutes.clear();
+      InterfaceState &ifs = InsertInterfaceState(i);
+      ifs.address = m_ipv4->GetAddress(i, 0);
+      ifs.subnetBroadcast = addr.GetSubnetDirectedBroadcast(ifs.address.GetMask());
       if (addr == Ipv4Address::GetLoopback())
         return;
+      if (ifs.excluded)
+        {
+          NS_LOG_DEBUG("Interface "<< i <<" excluded from multicast: no PIM socket");
+          return;
+        }
       Ipv4Address socketAddr;
       if (m_mainAddress == Ipv4Address())
         {
@@ -633,6 +805,7 @@ MulticastRoutingProtocol::GetTypeId (void)
         }
       socket->BindToNetDevice(m_ipv4->GetNetDevice(i));
       m_socketAddresses[socket] = m_ipv4->GetAddress(i, 0);
+      ifs.socket = socket;
       NS_LOG_DEBUG("Socket "<<socket << " Device "<<m_ipv4->GetNetDevice (i)<<" Iface "<<i
           << " Addr "<< addr
           <<" Broad "<< addr.GetSubnetDirectedBroadcast (m_ipv4->GetAddress (i, 0).GetMask ())
@@ -652,11 +825,16 @@ MulticastRoutingProtocol::GetTypeId (void)
       NS_LOG_DEBUG ("Neighborhood ("<<i<<"): PD " << ns->propagationDelay.GetSeconds() <<"s OI "<< ns->overrideInterval.GetSeconds() <<
           "s SRI "<< ns->stateRefreshInterval.GetSeconds()<<"s PHT "<< ns->pruneHoldtime.GetSeconds()<<"s LDE "<<ns->LANDelayEnabled<<
           "s SRC "<< ns->stateRefreshCapable);
+      if (m_helloTimer.IsRunning())
+        { // PIM enabled on a new interface while running: announce it without touching the shared timer;
+          // during setup the first Hello of the shared timer already covers it
+          if (m_started)
+            TriggerHello(i, Ipv4Address(ALL_PIM_ROUTERS4));
+          return;
+        }
       Time rndHello = m_startDelay + TransmissionDelay(0, Triggered_Hello_Delay);
-      Simulator::Schedule(rndHello, &MulticastRoutingProtocol::HelloTimerExpire, this, i);
-      ns->hello_timer.SetDelay(m_helloTime);
-      ns->hello_timer.SetFunction(&MulticastRoutingProtocol::HelloTimerExpire, this);
-      ns->hello_timer.SetArguments(i);
+      m_helloTimer.SetFunction(&MulticastRoutingProtocol::HelloTimerExpire, this);
+      m_helloTimer.Schedule(rndHello);
       NS_LOG_DEBUG ("SourceGroup List("<<i<<") HT "<<m_helloTime.GetSeconds()<<"s Starting "<< rndHello.GetSeconds()<<"s");
     }
 
@@ -664,6 +842,7 @@ MulticastRoutingProtocol::GetTypeId (void)
     MulticastRoutingProtocol::NotifyRemoveAddress (uint32_t interface, Ipv4InterfaceAddress address)
     {
       NS_LOG_FUNCTION(this);NS_LOG_DEBUG("- Address("<<interface<<") = "<< address);
+      m_outputRoutes.clear();
     }
 
     void
@@ -680,9 +859,37 @@ MulticastRoutingProtocol::GetTypeId (void)
     MulticastRoutingProtocol::GetLocalAddress (uint32_t interface)
     {
       NS_ASSERT(interface<m_ipv4->GetNInterfaces () && interface >= 0);
+      if (interface < m_interfaces.size() && m_interfaces[interface].address.GetLocal() != Ipv4Address())
+        return m_interfaces[interface].address.GetLocal();
       return m_ipv4->GetAddress(interface, 0).GetLocal();
     }
 
+    InterfaceState*
+    MulticastRoutingProtocol::FindInterfaceState (uint32_t interface)
+    {
+      return (interface < m_interfaces.size() ? &m_interfaces[interface] : NULL);
+    }
+
+    InterfaceState&
+    MulticastRoutingProtocol::InsertInterfaceState (uint32_t interface)
+    {
+      if (interface >= m_interfaces.size())
+        {
+          size_t first = m_interfaces.size();
+          m_interfaces.resize(interface + 1);
+          for (size_t i = first; i < m_interfaces.size(); i++)
+            m_interfaces[i].excluded = m_interfaceExclusions.find(i) != m_interfaceExclusions.end();
+        }
+      return m_interfaces[interface];
+    }
+
+    inline bool
+    MulticastRoutingProtocol::IsExcluded (uint32_t interface)
+    {
+      return (interface < m_interfaces.size() ? m_interfaces[interface].excluded
+          : m_interfaceExclusions.find(interface) != m_interfaceExclusions.end());
+    }
+
     void
     MulticastRoutingProtocol::DoDispose ()
     {
@@ -696,10 +903,31 @@ MulticastRoutingProtocol::GetTypeId (void)
           iter->first->Close();
         }
       m_socketAddresses.clear();
+      for (std::vector<InterfaceState>::iterator iter = m_interfaces.begin(); iter != m_interfaces.end(); iter++)
+        {
+          if (iter->dataSocket)
+            iter->dataSocket->Close();
+          iter->controlDrain.Cancel();
+          iter->relayRelease.Cancel();
+        }
+      m_dataGroups.clear();
+      m_nativeRoutes.clear();
+      m_duplicates.clear();
+      m_duplicateOrder.clear();
       m_IfaceNeighbors.clear();
-      m_IfacePimEnabled.clear();
+      m_interfaces.clear();
       m_IfaceSourceGroup.clear();
       m_mrib.clear();
+      m_outputRoutes.clear();
+      m_policers.clear();
+      m_refreshTemplates.clear();
+      m_helloTimer.Cancel();
+      for (std::map<Ipv4Address, PendingRoute>::iterator iter = m_pendingRoutes.begin(); iter != m_pendingRoutes.end();
+          iter++)
+        {
+          iter->second.probe.Cancel();
+        }
+      m_pendingRoutes.clear();
       Ipv4RoutingProtocol::DoDispose();
     }
 
@@ -732,6 +960,7 @@ MulticastRoutingProtocol::GetTypeId (void)
       if (m_generationID == 0)
         m_generationID = UniformVariable().GetInteger(1, UINT_MAX);	          ///force value > 0
       m_startTime = Simulator::Now();
+      m_started = true;
       m_rpfChecker.Cancel();
       m_rpfChecker.SetFunction(&MulticastRoutingProtocol::RPFCheckAll, this);
       m_rpfChecker.SetDelay(m_rpfCheck);
@@ -752,16 +981,25 @@ MulticastRoutingProtocol::GetTypeId (void)
 //	   Hello messages on all active interfaces.  The Hello Timer SHOULD NOT
 //	   be reset except when it expires.
     void
-    MulticastRoutingProtocol::HelloTimerExpire (uint32_t i)
+    MulticastRoutingProtocol::HelloTimerExpire ()
     {
-      NS_LOG_FUNCTION(this << i);
-      if (IsLoopInterface(i))
-        return;
-      //Ipv4Address addr = m_ipv4->GetAddress(i, 0).GetLocal();
-      Timer &nHelloTimer = m_IfaceNeighbors.find(i)->second.hello_timer;
-      NS_ASSERT(!nHelloTimer.IsRunning());
-      nHelloTimer.Schedule();
-      SendHello(i);
+      NS_LOG_FUNCTION(this);
+      NS_ASSERT(!m_helloTimer.IsRunning());
+      m_helloTimer.Schedule(m_helloTime);
+      for (std::map<uint32_t, NeighborhoodStatus>::const_iterator iter = m_IfaceNeighbors.begin();
+          iter != m_IfaceNeighbors.end(); iter++)
+        {
+          if (IsLoopInterface(iter->first) || iter->first == m_hostInterface || IsExcluded(iter->first))
+            continue;
+          // Neighbors refreshed our liveness within the last half period: the next check is still well within the Hold Time.
+          if (m_helloSuppression && !iter->second.neighbors.empty() && !iter->second.lastControlTx.IsZero()
+              && Simulator::Now() - iter->second.lastControlTx < Seconds(m_helloTime.GetSeconds() * .5))
+            {
+              NS_LOG_DEBUG("Hello on interface "<< iter->first<<" suppressed, last control message at "<< iter->second.lastControlTx.GetSeconds());
+              continue;
+            }
+          SendHello(iter->first);
+        }
     }
 
     bool
@@ -907,9 +1145,10 @@ MulticastRoutingProtocol::GetTypeId (void)
     {
       PIMHeader::HelloMessage::HelloEntry lanpd =
         { PIMHeader::HelloMessage::LANPruneDelay, PIM_DM_HELLO_LANPRUNDELAY };
+      NeighborhoodStatus *nstatus = FindNeighborhoodStatus(interface);
       lanpd.m_optionValue.lanPruneDelay.s_T = 0;
-      lanpd.m_optionValue.lanPruneDelay.s_propagationDelay = m_IfaceNeighbors.find(interface)->second.propagationDelay;
-      lanpd.m_optionValue.lanPruneDelay.s_overrideInterval = m_IfaceNeighbors.find(interface)->second.overrideInterval;
+      lanpd.m_optionValue.lanPruneDelay.s_propagationDelay = nstatus->propagationDelay;
+      lanpd.m_optionValue.lanPruneDelay.s_overrideInterval = nstatus->overrideInterval;
       msg.GetHelloMessage().m_optionList.push_back(lanpd);
     }
 
@@ -928,8 +1167,8 @@ MulticastRoutingProtocol::GetTypeId (void)
       PIMHeader::HelloMessage::HelloEntry staterefresh =
         { PIMHeader::HelloMessage::StateRefreshCapable, PIM_DM_HELLO_STATEREFRESH };
       staterefresh.m_optionValue.stateRefreshCapable.s_version = 1;
-      staterefresh.m_optionValue.stateRefreshCapable.s_interval = (uint8_t) (m_IfaceNeighbors.find(interface)->second
-          .stateRefreshInterval).GetSeconds();
+      staterefresh.m_optionValue.stateRefreshCapable.s_interval = (uint8_t) FindNeighborhoodStatus(interface)
+          ->stateRefreshInterval.GetSeconds();
       staterefresh.m_optionValue.stateRefreshCapable.s_reserved = 0;
       msg.GetHelloMessage().m_optionList.push_back(staterefresh);
     }
@@ -942,7 +1181,7 @@ MulticastRoutingProtocol::GetTypeId (void)
       ForgeHelloMessageHoldTime(interface, msg);
       ForgeHelloMessageLANPD(interface, msg);
       ForgeHelloMessageGenID(interface, msg);
-      if (m_IfaceNeighbors.find(interface)->second.stateRefreshCapable)
+      if (FindNeighborhoodStatus(interface)->stateRefreshCapable)
         {
           ForgeHelloMessageStateRefresh(interface, msg);
         }
@@ -952,28 +1191,77 @@ MulticastRoutingProtocol::GetTypeId (void)
     MulticastRoutingProtocol::SendHello (uint32_t interface)
     {	///< Sec. 4.3.1. RFC 3973
       NS_LOG_FUNCTION(this << GetLocalAddress(interface)<< interface);
-      Ptr<Packet> packet = Create<Packet>();
-      PIMHeader msg;
-      ForgeHelloMessage(interface, msg);
-      msg.GetHelloMessage().m_destination = Ipv4Address(ALL_PIM_ROUTERS4);
-      Time delay = TransmissionDelay();
+      Time delay = ControlJitter(interface);
       NS_LOG_INFO("Node "<<GetLocalAddress(interface) << " sends hello in "<<delay.GetSeconds()<<"sec.");
-      Simulator::Schedule(delay, &MulticastRoutingProtocol::SendPacketPIMRoutersInterface, this, packet, msg,
-          interface);
+      QueueControlPacket(interface, HelloPacket(interface), delay);
     }
 
     void
     MulticastRoutingProtocol::SendHelloReply (uint32_t interface, Ipv4Address destination)
     {	///< Sec. 4.3.1. RFC 3973
       NS_LOG_FUNCTION(this << GetLocalAddress(interface) << destination << interface);
-      Ptr<Packet> packet = Create<Packet>();
+      Time delay = ControlJitter(interface);
+      NS_LOG_INFO("Node "<<GetLocalAddress(interface) << " sends hello reply  to " <<destination << " in "<<delay.GetSeconds()<<"sec.");
+      QueueControlPacket(interface, HelloPacket(interface), delay); // the destination is not part of the Hello on the wire
+    }
+
+    Ptr<Packet>
+    MulticastRoutingProtocol::HelloPacket (uint32_t interface)
+    {
+      InterfaceState *ifs = FindInterfaceState(interface);
+      NeighborhoodStatus *nstatus = FindNeighborhoodStatus(interface);
+      NS_ASSERT(nstatus);
+      HelloCache *cache = (ifs ? &ifs->hello : NULL);
+      if (cache && cache->packet && cache->holdTime == m_helloHoldTime && cache->generationID == m_generationID
+          && cache->propagationDelay == nstatus->propagationDelay && cache->overrideInterval == nstatus->overrideInterval
+          && cache->stateRefreshCapable == nstatus->stateRefreshCapable
+          && cache->stateRefreshInterval == nstatus->stateRefreshInterval)
+        return cache->packet->Copy();
+      // the options changed since the last Hello: serialize it again
       PIMHeader msg;
       ForgeHelloMessage(interface, msg);
-      msg.GetHelloMessage().m_destination = destination;
-      Time delay = TransmissionDelay();
-      NS_LOG_INFO("Node "<<GetLocalAddress(interface) << " sends hello reply  to " <<destination << " in "<<delay.GetSeconds()<<"sec.");
-      Simulator::Schedule(delay, &MulticastRoutingProtocol::SendPacketPIMRoutersInterface, this, packet, msg,
-          interface);
+      Ptr<Packet> packet = Create<Packet>();
+      packet->AddHeader(msg);
+      if (cache)
+        {
+          cache->packet = packet->Copy();
+          cache->holdTime = m_helloHoldTime;
+          cache->generationID = m_generationID;
+          cache->propagationDelay = nstatus->propagationDelay;
+          cache->overrideInterval = nstatus->overrideInterval;
+          cache->stateRefreshCapable = nstatus->stateRefreshCapable;
+          cache->stateRefreshInterval = nstatus->stateRefreshInterval;
+        }
+      return packet;
+    }
+
+    void
+    MulticastRoutingProtocol::TriggerHello (uint32_t interface, Ipv4Address neighbor)
+    {
+      NS_LOG_FUNCTION(this << interface << neighbor);
+      NeighborhoodStatus *nst = FindNeighborhoodStatus(interface);
+      NS_ASSERT(nst != NULL);
+      if (nst->triggeredHello.IsRunning())
+        {
+          nst->triggeredHelloTarget = Ipv4Address(ALL_PIM_ROUTERS4);
+          NS_LOG_DEBUG("Hello to "<< neighbor<< " merged with the pending one on interface "<< interface);
+          return;
+        }
+      // If a Hello message is received from a new neighbor, the receiving router SHOULD send its own Hello message
+      //    after a random delay between 0 and Triggered_Hello_Delay.
+      Time delay = TransmissionDelay(0, Triggered_Hello_Delay);
+      nst->triggeredHelloTarget = neighbor;
+      nst->triggeredHello = Simulator::Schedule(delay, &MulticastRoutingProtocol::SendTriggeredHello, this, interface);
+      NS_LOG_DEBUG("Neighbors = "<< nst->neighbors.size() << ", reply at "<<(Simulator::Now()+delay).GetSeconds());
+    }
+
+    void
+    MulticastRoutingProtocol::SendTriggeredHello (uint32_t interface)
+    {
+      NeighborhoodStatus *nst = FindNeighborhoodStatus(interface);
+      if (nst == NULL)
+        return;
+      SendHelloReply(interface, nst->triggeredHelloTarget);
     }
 
     void
@@ -997,11 +1285,15 @@ MulticastRoutingProtocol::GetTypeId (void)
       CreateMulticastGroupEntry(mge, ForgeEncodedGroup(sgp.groupMulticastAddr));
       AddMulticastGroupSourcePrune(mge, ForgeEncodedSource(sgp.sourceMulticastAddr));
       AddMulticastGroupEntry(msg, mge);
-      Ptr<Packet> packet = Create<Packet>();
-      Time delay = TransmissionDelay();
+      Time delay = ControlJitter(interface);
       NS_LOG_INFO ("Node " << GetLocalAddress(interface)<<" SendPrune to "<< target<<" in "<<delay.GetSeconds()<<"sec");
-      Simulator::Schedule(delay, &MulticastRoutingProtocol::SendPacketPIMRoutersInterface, this, packet, msg,
-          interface);
+      QueueControl(interface, msg, delay);
+      if (m_pruneAck)
+        {
+          SourceGroupState *sgState = FindSourceGroupState(interface, target, sgp);
+          if (sgState && sgState->upstream.valid && sgState->upstream.GraftPrune == GP_Pruned)
+            UpdatePruneRetryTimer(sgp, interface, target);
+        }
     }
 
     void
@@ -1064,10 +1356,8 @@ MulticastRoutingProtocol::GetTypeId (void)
       CreateMulticastGroupEntry(mge, ForgeEncodedGroup(sgp.groupMulticastAddr));
       AddMulticastGroupSourceJoin(mge, ForgeEncodedSource(sgp.sourceMulticastAddr));
       AddMulticastGroupEntry(msg, mge);
-      Ptr<Packet> packet = Create<Packet>();
-      Time delay = TransmissionDelay();
-      Simulator::Schedule(delay, &MulticastRoutingProtocol::SendPacketPIMRoutersInterface, this, packet, msg,
-          interface);
+      Time delay = ControlJitter(interface);
+      QueueControl(interface, msg, delay);
       NS_LOG_INFO ("Node " << m_mainAddress<<" SendJoin to "<< destination<<" in "<<delay.GetSeconds()<<"sec");
     }
 
@@ -1130,7 +1420,6 @@ MulticastRoutingProtocol::GetTypeId (void)
     MulticastRoutingProtocol::SendGraftBroadcast (uint32_t interface, Ipv4Address destination, SourceGroupPair sgp)
     {
       NS_LOG_FUNCTION(this);
-      Ptr<Packet> packet = Create<Packet>();
       PIMHeader msg; // Create the graft packet
       ForgeGraftMessage(PIM_GRAFT, msg, sgp, destination);
       PIMHeader::MulticastGroupEntry mge;
@@ -1139,9 +1428,11 @@ MulticastRoutingProtocol::GetTypeId (void)
       AddMulticastGroupEntry(msg, mge);
       NS_LOG_INFO ("Node " << m_mainAddress <<" SendGraft to upstream "<< destination);
       // Send the packet toward the RPF(S)
-      Time delay = TransmissionDelay();
-      Simulator::Schedule(delay, &MulticastRoutingProtocol::SendPacketPIMRoutersInterface, this, packet, msg,
-          interface);
+      Time delay = ControlJitter(interface);
+      QueueControl(interface, msg, delay);
+      SourceGroupState *sgState = FindSourceGroupState(interface, destination, sgp);
+      if (sgState)
+        sgState->upstream.graftSent = Simulator::Now() + delay;
     }
 
     void
@@ -1179,7 +1470,6 @@ MulticastRoutingProtocol::GetTypeId (void)
                                                      SourceGroupPair &sgp)
     {
       NS_LOG_FUNCTION(this);
-      Ptr<Packet> packet = Create<Packet>();
       PIMHeader::MulticastGroupEntry mge;
       CreateMulticastGroupEntry(mge, ForgeEncodedGroup(sgp.groupMulticastAddr));
       AddMulticastGroupSourceJoin(mge, ForgeEncodedSource(sgp.sourceMulticastAddr));
@@ -1188,8 +1478,22 @@ MulticastRoutingProtocol::GetTypeId (void)
       AddMulticastGroupEntry(msg, mge);
       NS_LOG_INFO ("Node " << m_mainAddress <<" SendGraftAck to "<< destination);
       // Send the packet toward the RPF(S)
-      Simulator::Schedule(TransmissionDelay(), &MulticastRoutingProtocol::SendPacketPIMRoutersInterface, this, packet,
-          msg, interface);
+      QueueControl(interface, msg, ControlJitter(interface));
+    }
+
+    void
+    MulticastRoutingProtocol::SendPruneAckBroadcast (uint32_t interface, const Ipv4Address destination,
+                                                     SourceGroupPair &sgp)
+    {
+      NS_LOG_FUNCTION(this);
+      PIMHeader::MulticastGroupEntry mge;
+      CreateMulticastGroupEntry(mge, ForgeEncodedGroup(sgp.groupMulticastAddr));
+      AddMulticastGroupSourcePrune(mge, ForgeEncodedSource(sgp.sourceMulticastAddr));
+      PIMHeader msg;
+      ForgeGraftAckMessage(msg, destination);
+      AddMulticastGroupEntry(msg, mge);
+      NS_LOG_INFO ("Node " << m_mainAddress <<" SendPruneAck to "<< destination);
+      QueueControl(interface, msg, ControlJitter(interface));
     }
 
     void
@@ -1216,10 +1520,8 @@ MulticastRoutingProtocol::GetTypeId (void)
       NS_LOG_FUNCTION(this);
       PIMHeader assertR;
       ForgeAssertMessage(interface, destination, assertR, sgp);
-      Ptr<Packet> packet = Create<Packet>();
       NS_LOG_INFO ("Node " << GetLocalAddress(interface)<< " SendAssert to "<<destination << " for "<<sgp);
-      Simulator::Schedule(TransmissionDelay(), &MulticastRoutingProtocol::SendPacketPIMRoutersInterface, this, packet,
-          assertR, interface);
+      QueueControl(interface, assertR, ControlJitter(interface));
     }
 
     void
@@ -1243,9 +1545,7 @@ MulticastRoutingProtocol::GetTypeId (void)
       NS_LOG_FUNCTION(this);
       PIMHeader assertR;
       ForgeAssertCancelMessage(interface, assertR, sgp);
-      Ptr<Packet> packet = Create<Packet>();
-      Simulator::Schedule(TransmissionDelay(), &MulticastRoutingProtocol::SendPacketPIMRoutersInterface, this, packet,
-          assertR, interface);
+      QueueControl(interface, assertR, ControlJitter(interface));
       NS_LOG_INFO ("Node "<<GetLocalAddress(interface)<< " SendAssertCancel to "<<destination);
     }
 
@@ -1254,12 +1554,14 @@ MulticastRoutingProtocol::GetTypeId (void)
                                                  const Ipv4Address destination)
     {
       NS_LOG_INFO("Node "<< GetLocalAddress(interface)<< " TimerUpdate "<< Assert_Time<< " To "<< destination);
-      SourceGroupState *sgState = FindSourceGroupState(interface, destination, sgp);
-      if (sgState->SG_AT.IsRunning())
-        sgState->SG_AT.Cancel();
+      UpdateAssertTimer(FindSourceGroupState(interface, destination, sgp), delay);
+    }
+
+    void
+    MulticastRoutingProtocol::UpdateAssertTimer (SourceGroupState *sgState, Time delay)
+    {
+      sgState->SG_AT.Cancel();
       sgState->SG_AT.SetDelay(delay);
-      sgState->SG_AT.SetFunction(&MulticastRoutingProtocol::ATTimerExpire, this);
-      sgState->SG_AT.SetArguments(sgp, interface, destination);
       sgState->SG_AT.Schedule();
     }
 
@@ -1267,11 +1569,13 @@ MulticastRoutingProtocol::GetTypeId (void)
     MulticastRoutingProtocol::UpdatePruneTimer (SourceGroupPair &sgp, uint32_t interface, Time delay,
                                                 const Ipv4Address destination)
     {
-      SourceGroupState *sgState = FindSourceGroupState(interface, destination, sgp);
-      if (sgState->SG_PT.IsRunning())
-        sgState->SG_PT.Cancel();
-      sgState->SG_PT.SetFunction(&MulticastRoutingProtocol::PTTimerExpire, this);
-      sgState->SG_PT.SetArguments(sgp, interface, destination);
+      UpdatePruneTimer(FindSourceGroupState(interface, destination, sgp), delay);
+    }
+
+    void
+    MulticastRoutingProtocol::UpdatePruneTimer (SourceGroupState *sgState, Time delay)
+    {
+      sgState->SG_PT.Cancel();
       sgState->SG_PT.SetDelay(delay);
       sgState->SG_PT.Schedule();
     }
@@ -1280,25 +1584,29 @@ MulticastRoutingProtocol::GetTypeId (void)
     MulticastRoutingProtocol::UpdatePruneDownstreamTimer (SourceGroupPair &sgp, uint32_t interface,
                                                           const Ipv4Address destination)
     {
-      SourceGroupState *sgState = FindSourceGroupState(interface, destination, sgp);
+      UpdatePruneDownstreamTimer(FindSourceGroupState(interface, destination, sgp));
+    }
+
+    void
+    MulticastRoutingProtocol::UpdatePruneDownstreamTimer (SourceGroupState *sgState)
+    {
       if (sgState->SG_PLTD.IsRunning())
         return;
-      sgState->SG_PLTD.SetFunction(&MulticastRoutingProtocol::PLTTimerExpireDownstream, this);
-      sgState->SG_PLTD.SetArguments(sgp, (uint32_t) interface, destination);
-      sgState->SG_PLTD.SetDelay(TransmissionDelay(PRUNE_DOWN * .2 * 1000, PRUNE_DOWN * 1000, Time::MS));
-      sgState->SG_PLTD.Schedule();
+      sgState->SG_PLTD.Schedule(TransmissionDelay(PRUNE_DOWN * .2 * 1000, PRUNE_DOWN * 1000, Time::MS));
     }
     void
     MulticastRoutingProtocol::UpdatePrunePendingTimer (SourceGroupPair &sgp, uint32_t interface, Time delay,
                                                        const Ipv4Address destination)
     {
-      SourceGroupState *sgState = FindSourceGroupState(interface, destination, sgp);
+      UpdatePrunePendingTimer(FindSourceGroupState(interface, destination, sgp), delay);
+    }
+
+    void
+    MulticastRoutingProtocol::UpdatePrunePendingTimer (SourceGroupState *sgState, Time delay)
+    {
       if (sgState->SG_PPT.IsRunning())
         return;
-      sgState->SG_PPT.SetDelay(delay);
-      sgState->SG_PPT.SetFunction(&MulticastRoutingProtocol::PPTTimerExpire, this);
-      sgState->SG_PPT.SetArguments(sgp, interface, destination);
-      sgState->SG_PPT.Schedule();
+      sgState->SG_PPT.Schedule(delay);
     }
 
     void
@@ -1312,35 +1620,83 @@ MulticastRoutingProtocol::GetTypeId (void)
     MulticastRoutingProtocol::UpdateGraftTimer (SourceGroupPair &sgp, uint32_t interface, Time delay,
                                                 const Ipv4Address destination)
     {
-      SourceGroupState *sgState = FindSourceGroupState(interface, destination, sgp);
+      UpdateGraftTimer(FindSourceGroupState(interface, destination, sgp), delay);
+    }
+
+    void
+    MulticastRoutingProtocol::UpdateGraftTimer (SourceGroupState *sgState, Time delay)
+    {
       NS_ASSERT(sgState->upstream.valid);
       if (sgState->upstream.SG_GRT.IsRunning())
         return;
-      sgState->upstream.SG_GRT.SetDelay(delay);
-      sgState->upstream.SG_GRT.SetFunction(&MulticastRoutingProtocol::GRTTimerExpire, this);
-      sgState->upstream.SG_GRT.SetArguments(sgp, interface, destination);
-      sgState->upstream.SG_GRT.Schedule();
+      sgState->upstream.SG_GRT.Schedule(delay);
     }
 
     void
     MulticastRoutingProtocol::UpdateGraftTimer (SourceGroupPair &sgp, uint32_t interface, const Ipv4Address destination)
     {
-      UpdateGraftTimer(sgp, interface, Seconds(Graft_Retry_Period), destination);
+      UpdateGraftTimer(sgp, interface, GraftRetryPeriod(interface, destination), destination);
+    }
+
+    Time
+    MulticastRoutingProtocol::GraftRetryPeriod (uint32_t interface, const Ipv4Address destination)
+    {
+      NeighborState *ns = FindNeighborState(interface, destination, GetLocalAddress(interface));
+      if (!m_graftRetryAdaptive || !ns || ns->neighborGraftSRTT.IsZero())
+        return Seconds(Graft_Retry_Period);
+      double rto = ns->neighborGraftSRTT.GetSeconds() + 4 * ns->neighborGraftRTTVAR.GetSeconds();
+      rto = std::max(rto, Graft_Retry_Min) * (1 << std::min<uint8_t>(ns->neighborGraftRetry[0], MaxGraftRetry));
+      NS_LOG_DEBUG("Graft retry towards "<< destination<< " in "<< std::min(rto, (double) Graft_Retry_Period)<<"s, SRTT "
+          << ns->neighborGraftSRTT.GetSeconds()<<"s RTTVAR "<< ns->neighborGraftRTTVAR.GetSeconds()<<"s retry "<<(uint16_t)ns->neighborGraftRetry[0]);
+      return Seconds(std::min(rto, (double) Graft_Retry_Period));
+    }
+
+    void
+    MulticastRoutingProtocol::UpdateGraftRtt (NeighborState *ns, Time sample)
+    {
+      NS_ASSERT(ns);
+      if (ns->neighborGraftSRTT.IsZero())
+        {
+          ns->neighborGraftSRTT = sample;
+          ns->neighborGraftRTTVAR = Seconds(sample.GetSeconds() / 2);
+          return;
+        }
+      double srtt = ns->neighborGraftSRTT.GetSeconds();
+      double delta = srtt > sample.GetSeconds() ? srtt - sample.GetSeconds() : sample.GetSeconds() - srtt;
+      ns->neighborGraftRTTVAR = Seconds(.75 * ns->neighborGraftRTTVAR.GetSeconds() + .25 * delta);
+      ns->neighborGraftSRTT = Seconds(.875 * srtt + .125 * sample.GetSeconds());
+    }
+
+    void
+    MulticastRoutingProtocol::UpdatePruneRetryTimer (SourceGroupPair &sgp, uint32_t interface,
+                                                     const Ipv4Address destination)
+    {
+      UpdatePruneRetryTimer(FindSourceGroupState(interface, destination, sgp));
+    }
+
+    void
+    MulticastRoutingProtocol::UpdatePruneRetryTimer (SourceGroupState *sgState)
+    {
+      NS_ASSERT(sgState->upstream.valid);
+      if (sgState->upstream.SG_PRT.IsRunning())
+        return;
+      sgState->upstream.SG_PRT.Schedule(m_pruneRetryPeriod);
     }
 
     void
     MulticastRoutingProtocol::UpdateOverrideTimer (SourceGroupPair &sgp, uint32_t interface, Time delay,
                                                    const Ipv4Address destination)
     {
-      SourceGroupState *sgState = FindSourceGroupState(interface, destination, sgp);
+      UpdateOverrideTimer(FindSourceGroupState(interface, destination, sgp), delay);
+    }
+
+    void
+    MulticastRoutingProtocol::UpdateOverrideTimer (SourceGroupState *sgState, Time delay)
+    {
       NS_ASSERT(sgState->upstream.valid);
       if (sgState->upstream.SG_OT.IsRunning())
         return;
-      sgState->upstream.SG_OT.Cancel();
-      sgState->upstream.SG_OT.SetDelay(delay);
-      sgState->upstream.SG_OT.SetFunction(&MulticastRoutingProtocol::OTTimerExpire, this);
-      sgState->upstream.SG_OT.SetArguments(sgp, interface, destination);
-      sgState->upstream.SG_OT.Schedule();
+      sgState->upstream.SG_OT.Schedule(delay);
     }
     void
     MulticastRoutingProtocol::UpdateOverrideTimer (SourceGroupPair &sgp, uint32_t interface,
@@ -1352,13 +1708,16 @@ MulticastRoutingProtocol::GetTypeId (void)
     MulticastRoutingProtocol::UpdatePruneLimitTimer (SourceGroupPair &sgp, uint32_t interface, Time delay,
                                                      const Ipv4Address destination)
     {
-      SourceGroupState *sgState = FindSourceGroupState(interface, destination, sgp);
+      UpdatePruneLimitTimer(FindSourceGroupState(interface, destination, sgp), delay);
+    }
+
+    void
+    MulticastRoutingProtocol::UpdatePruneLimitTimer (SourceGroupState *sgState, Time delay)
+    {
       NS_ASSERT(sgState->upstream.valid);
       if (sgState->upstream.SG_PLT.IsRunning())
         return;
       sgState->upstream.SG_PLT.SetDelay(delay);
-      sgState->upstream.SG_PLT.SetFunction(&MulticastRoutingProtocol::PLTTimerExpire, this); //re-schedule transmission
-      sgState->upstream.SG_PLT.SetArguments(sgp, interface, destination);
       sgState->upstream.SG_PLT.Schedule();
     }
     void
@@ -1371,13 +1730,17 @@ MulticastRoutingProtocol::GetTypeId (void)
     MulticastRoutingProtocol::UpdateSourceActiveTimer (SourceGroupPair &sgp, uint32_t interface, Time delay,
                                                        const Ipv4Address destination)
     {
-      SourceGroupState *sgState = FindSourceGroupState(interface, destination, sgp);
+      UpdateSourceActiveTimer(FindSourceGroupState(interface, destination, sgp), delay);
+    }
+
+    void
+    MulticastRoutingProtocol::UpdateSourceActiveTimer (SourceGroupState *sgState, Time delay)
+    {
       NS_ASSERT(sgState->upstream.valid);
+      sgState->upstream.sourceActive = Simulator::Now();
       if (sgState->upstream.SG_SAT.IsRunning())
-        return;
+        return; // the deadline moved, SATTimerExpire re-arms for the time left
       sgState->upstream.SG_SAT.SetDelay(delay);
-      sgState->upstream.SG_SAT.SetFunction(&MulticastRoutingProtocol::SATTimerExpire, this);
-      sgState->upstream.SG_SAT.SetArguments(sgp, interface, destination);
       sgState->upstream.SG_SAT.Schedule();
     }
     void
@@ -1390,14 +1753,16 @@ MulticastRoutingProtocol::GetTypeId (void)
     MulticastRoutingProtocol::UpdateStateRefreshTimer (SourceGroupPair &sgp, uint32_t interface, Time delay,
                                                        const Ipv4Address destination)
     {
-      SourceGroupState *sgState = FindSourceGroupState(interface, destination, sgp);
+      UpdateStateRefreshTimer(FindSourceGroupState(interface, destination, sgp), delay);
+    }
+
+    void
+    MulticastRoutingProtocol::UpdateStateRefreshTimer (SourceGroupState *sgState, Time delay)
+    {
       NS_ASSERT(sgState->upstream.valid);
       if (sgState->upstream.SG_SRT.IsRunning())
         return;
-      sgState->upstream.SG_SRT.SetDelay(delay);
-      sgState->upstream.SG_SRT.SetFunction(&MulticastRoutingProtocol::SRTTimerExpire, this);
-      sgState->upstream.SG_SRT.SetArguments(sgp, interface);
-      sgState->upstream.SG_SRT.Schedule();
+      sgState->upstream.SG_SRT.Schedule(delay);
     }
     void
     MulticastRoutingProtocol::UpdateStateRefreshTimer (SourceGroupPair &sgp, uint32_t interface,
@@ -1443,13 +1808,63 @@ MulticastRoutingProtocol::GetTypeId (void)
       refresh.m_interval = RefreshInterval;
     }
 
+    Ptr<Packet>
+    MulticastRoutingProtocol::StateRefreshPacket (uint32_t interface, const SourceGroupPair &sgp, PIMHeader &msg)
+    {
+      PIMHeader::StateRefreshMessage &refresh = msg.GetStateRefreshMessage();
+      StateRefreshTemplate &tpl = m_refreshTemplates[std::pair<SourceGroupPair, uint32_t>(sgp, interface)];
+      if (tpl.bytes.empty() || tpl.originator != refresh.m_originatorAddr.m_unicastAddress
+          || tpl.metricPreference != refresh.m_metricPreference || tpl.metric != refresh.m_metric
+          || tpl.interval != refresh.m_interval)
+        {
+          Ptr<Packet> packet = Create<Packet>();
+          packet->AddHeader(msg);
+          tpl.bytes.resize(packet->GetSize());
+          packet->CopyData(&tpl.bytes[0], tpl.bytes.size());
+          tpl.originator = refresh.m_originatorAddr.m_unicastAddress;
+          tpl.metricPreference = refresh.m_metricPreference;
+          tpl.metric = refresh.m_metric;
+          tpl.interval = refresh.m_interval;
+          return packet;
+        }
+      // only the TTL and the flags change between two State Refresh of the same (S,G) on the interface
+      PIMHeader::PatchStateRefresh(tpl.bytes, refresh);
+      return Create<Packet>(&tpl.bytes[0], tpl.bytes.size());
+    }
+
+    void
+    MulticastRoutingProtocol::RemoveStateRefreshTemplates (const SourceGroupPair &sgp)
+    {
+      for (std::map<std::pair<SourceGroupPair, uint32_t>, StateRefreshTemplate>::iterator iter = m_refreshTemplates.begin();
+          iter != m_refreshTemplates.end();)
+        {
+          if (iter->first.first.sourceMulticastAddr == sgp.sourceMulticastAddr
+              && iter->first.first.groupMulticastAddr == sgp.groupMulticastAddr)
+            m_refreshTemplates.erase(iter++);
+          else
+            iter++;
+        }
+    }
+
+    void
+    MulticastRoutingProtocol::RemoveStateRefreshTemplates (uint32_t interface)
+    {
+      for (std::map<std::pair<SourceGroupPair, uint32_t>, StateRefreshTemplate>::iterator iter = m_refreshTemplates.begin();
+          iter != m_refreshTemplates.end();)
+        {
+          if (iter->first.second == interface)
+            m_refreshTemplates.erase(iter++);
+          else
+            iter++;
+        }
+    }
+
     void
     MulticastRoutingProtocol::SendStateRefreshMessage (uint32_t interface, Ipv4Address destination,
                                                        SourceGroupPair &sgp)
     {
       NS_LOG_FUNCTION(this);
       SourceGroupState *sgState = FindSourceGroupState(interface, destination, sgp);
-      Ptr<Packet> packet = Create<Packet>();
       PIMHeader msg;
       ForgeStateRefresh(interface, destination, sgp, msg);
       NeighborhoodStatus *ns = FindNeighborhoodStatus(interface);
@@ -1460,8 +1875,7 @@ MulticastRoutingProtocol::GetTypeId (void)
       stateRefresh.m_metric = sgState->AssertWinner.routeMetric;
       stateRefresh.m_interval = (uint8_t) (tmp.GetSeconds());
       NS_LOG_INFO ("Node " << m_mainAddress <<" SendStateRefresh to upstream "<< destination);
-      Simulator::Schedule(TransmissionDelay(), &MulticastRoutingProtocol::SendPacketPIMRoutersInterface, this, packet,
-          msg, interface);
+      QueueControlPacket(interface, StateRefreshPacket(interface, sgp, msg), ControlJitter(interface));
       switch (sgState->PruneState)
         {
         case Prune_NoInfo:
@@ -1479,7 +1893,7 @@ MulticastRoutingProtocol::GetTypeId (void)
             //Send State Refresh(S, G) out interface I. The router has refreshed the Prune(S, G) state on interface I.
             //	The router MUST reset the Prune Timer (PT(S, G, I)) to the Holdtime from an active Prune received on interface I.
             //	The Holdtime used SHOULD be the largest active one but MAY be the most recently received active Prune Holdtime.
-            UpdatePruneTimer(sgp, interface, FindNeighborhoodStatus(interface)->pruneHoldtime, destination);
+            UpdatePruneTimer(sgState, FindNeighborhoodStatus(interface)->pruneHoldtime);
             break;
           }
         default:
@@ -1498,7 +1912,7 @@ MulticastRoutingProtocol::GetTypeId (void)
             //	The router is sending a State Refresh(S, G) message on interface I.
             //	The router MUST set the Assert Timer (AT(S, G, I)) to three
             //	times the State Refresh Interval contained in the State Refresh(S, G) message.
-            UpdateAssertTimer(sgp, interface, Seconds(3 * msg.GetStateRefreshMessage().m_interval), destination);
+            UpdateAssertTimer(sgState, Seconds(3 * msg.GetStateRefreshMessage().m_interval));
             break;
           }
         case Assert_Loser:
@@ -1630,10 +2044,13 @@ MulticastRoutingProtocol::GetTypeId (void)
       if (sgState->upstream.SG_SRT.IsRunning())
         sgState->upstream.SG_SRT.Cancel();
       sgState->upstream.origination = NotOriginator;
+      RemoveStateRefreshTemplates(sgp);
       sgState->upstream.GraftPrune = GP_Pruned;		//GP_NoInfo TODO
       sgState->upstream.valid = false;
       // starting new entries
       sgState = FindSourceGroupState(interfaceN, gatewayN, sgp, true); // find new RPF pair...
+      if (TibKey(interfaceN, gatewayN).second != gatewayN)
+        BindSourceGroupTimers(sgState, interfaceN, gatewayN); // shared entry: upstream timers follow the new RPF'(S)
       NS_ASSERT(isValidGateway(gatewayN));
       NS_ASSERT(sgState->upstream.valid);
       switch (sgState->upstream.GraftPrune)
@@ -1662,11 +2079,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                   {		// RPF_Prime changed with a new neighbor we didn't know before...
                     InsertNeighborState(interfaceN, gatewayN, GetLocalAddress(interfaceN));	//add it and send a Hello...
                     ns = FindNeighborState(interfaceN, gatewayN, GetLocalAddress(interfaceN));
-                    // If a Hello message is received from a new neighbor, the receiving router SHOULD send its own Hello message
-                    //    after a random delay between 0 and Triggered_Hello_Delay.
-                    Time delay = TransmissionDelay(0, Triggered_Hello_Delay);
-                    Simulator::Schedule(delay, &MulticastRoutingProtocol::SendHelloReply, this, interfaceN, gatewayN);
-                    NS_LOG_DEBUG("Neighbors = "<< FindNeighborhoodStatus(interfaceN)->neighbors.size() << ", reply at "<<(Simulator::Now()+delay).GetSeconds());
+                    TriggerHello(interfaceN, gatewayN);
                   }
                 UpdateGraftTimer(sgp, interfaceN, gatewayN);
               }
@@ -1748,22 +2161,25 @@ MulticastRoutingProtocol::GetTypeId (void)
       Ipv4Address receiverIfaceAddr = m_ipv4->GetAddress(interface, 0).GetLocal();
       NS_ASSERT(receiverIfaceAddr != Ipv4Address ());
       Ipv4Header ipv4header;
-      receivedPacket->RemoveHeader(ipv4header);
-      RelayTag rtag;
-      bool tag = receivedPacket->RemovePacketTag(rtag);
+      receivedPacket->PeekHeader(ipv4header);
       Ipv4Address group = ipv4header.GetDestination();
-      receivedPacket->AddHeader(ipv4header);
+      InterfaceState *ifs = FindInterfaceState(interface);
+      if (ifs && socket == ifs->dataSocket && m_dataGroups.find(group) == m_dataGroups.end())
+        return; // the data socket sees every UDP datagram on the interface: not a registered group
+      // the relay tag is read once here and travels with the packet as RelayInfo from now on
+      RelayTag rtag;
+      RelayInfo relay;
+      if (receivedPacket->RemovePacketTag(rtag))
+        relay = RelayInfo(rtag.m_sender, rtag.m_receiver);
       SnrTag ptag;
       receivedPacket->RemovePacketTag(ptag);
-      RoutingMulticastTable mt;
-      MulticastEntry me;
-      bool sourcePkt = Lookup(group, !tag ? senderIfaceAddr : rtag.m_sender, mt, me);
-      if ((tag || (group.IsMulticast() && group != Ipv4Address(ALL_PIM_ROUTERS4)))
+      std::map<Ipv4Address, RoutingMulticastTable>::const_iterator mt = m_mrib.find(group);
+      bool sourcePkt = mt != m_mrib.end()
+          && mt->second.mgroup.find(relay.relayed ? relay.sender : senderIfaceAddr) != mt->second.mgroup.end();
+      if ((relay.relayed || (group.IsMulticast() && group != Ipv4Address(ALL_PIM_ROUTERS4)))
           && (interface == m_mainInterface || sourcePkt))
         {
-          if (tag)
-            receivedPacket->AddPacketTag(rtag);
-          this->RecvPIMData(receivedPacket, senderIfaceAddr, senderIfacePort, interface);
+          this->RecvPIMData(receivedPacket, senderIfaceAddr, senderIfacePort, interface, relay);
         }
       else if ((group == Ipv4Address(ALL_PIM_ROUTERS4) || group == GetLocalAddress(interface))
           && interface == m_mainInterface)
@@ -1803,6 +2219,26 @@ MulticastRoutingProtocol::GetTypeId (void)
       //  Within PIM-DM, route and state information associated with an (S, G) entry MUST be maintained as long as any
       //	timer associated with that (S, G) entry is active.  When no timer associated with an (S, G) entry is active,
       //	all information concerning that (S, G) route may be discarded.
+      uint8_t verType = 0;
+      receivedPacket->CopyData(&verType, 1);
+      PIMType type = PIMType(verType & 0x0f);
+      if (m_helloSuppression && type != PIM_HELLO)
+        { // any control message from a known neighbor proves it is alive
+          NeighborState *ns = FindNeighborState(interface, senderIfaceAddr, receiverIfaceAddr);
+          if (ns && ns->neigborNLT.IsRunning())
+            ns->neighborRefresh = Simulator::Now();
+        }
+      if (type == PIM_JP || type == PIM_GRAFT)
+        { // walk the (group, source) pairs in place instead of building the entry lists
+          m_rxControlBytes.resize(receivedPacket->GetSize());
+          receivedPacket->CopyData(&m_rxControlBytes[0], m_rxControlBytes.size());
+          JoinPruneGraftView view(&m_rxControlBytes[0], m_rxControlBytes.size());
+          if (type == PIM_JP)
+            RecvJP(view, senderIfaceAddr, receiverIfaceAddr, interface);
+          else
+            RecvGraft(view, senderIfaceAddr, receiverIfaceAddr, interface);
+          return;
+        }
       PIMHeader pimdmPacket;
       receivedPacket->RemoveHeader(pimdmPacket);
       switch (pimdmPacket.GetType())
@@ -1812,21 +2248,11 @@ MulticastRoutingProtocol::GetTypeId (void)
             RecvHello(pimdmPacket.GetHelloMessage(), senderIfaceAddr, receiverIfaceAddr, interface);
             break;
           }
-        case PIM_JP:
-          {
-            RecvJP(pimdmPacket.GetJoinPruneMessage(), senderIfaceAddr, receiverIfaceAddr, interface);
-            break;
-          }
         case PIM_ASSERT:
           {
             RecvAssert(pimdmPacket.GetAssertMessage(), senderIfaceAddr, receiverIfaceAddr, interface);
             break;
           }
-        case PIM_GRAFT:
-          {
-            RecvGraft(pimdmPacket.GetGraftMessage(), senderIfaceAddr, receiverIfaceAddr, interface);
-            break;
-          }
         case PIM_GRAFT_ACK:
           {
             RecvGraftAck(pimdmPacket.GetGraftAckMessage(), senderIfaceAddr, receiverIfaceAddr, interface);
@@ -1847,14 +2273,13 @@ MulticastRoutingProtocol::GetTypeId (void)
 
     void
     MulticastRoutingProtocol::RecvPIMData (Ptr<Packet> receivedPacket, Ipv4Address senderIfaceAddr,
-                                           uint16_t senderIfacePort, uint32_t interface)
+                                           uint16_t senderIfacePort, uint32_t interface, const RelayInfo &relay)
     {
       NS_LOG_FUNCTION(this);
       NS_ASSERT(interface);
       Ipv4Address source, group, sender, destination, gateway;
       Ptr<Packet> copy = receivedPacket->Copy();	// Ipv4Header, UdpHeader and SocketAddressTag must be removed.
-      RelayTag relayTag;
-      bool rtag = copy->RemovePacketTag(relayTag); //Remove Tag and count
+      bool rtag = relay.relayed;
       m_rxDataPacketTrace(copy);
       Ipv4Header sourceHeader;
       copy->RemoveHeader(sourceHeader);
@@ -1864,28 +2289,38 @@ MulticastRoutingProtocol::GetTypeId (void)
       destination = group;
       if (rtag)
         {
-          sender = relayTag.m_sender;
-          destination = relayTag.m_receiver;
+          sender = relay.sender;
+          destination = relay.receiver;
         }
       Ptr<Ipv4Route> rpf_route = GetRoute(source);
-      if (rpf_route == NULL)
+      if (rpf_route == NULL || !isValidGateway(rpf_route->GetGateway()))
         {
+          EnqueuePendingData(source, receivedPacket, senderIfaceAddr, senderIfacePort, interface, relay);
           return AskRoute(source);
         }
+      if (m_pendingRoutes.find(source) != m_pendingRoutes.end())
+        RouteResolved(source); // older packets first
       gateway = rpf_route->GetGateway();
-      if (!isValidGateway(gateway))
-        {
-          return AskRoute(source);
-        }
+      if (m_nativeForwarding && !rtag && gateway != source
+          && (uint32_t) m_ipv4->GetInterfaceForDevice(rpf_route->GetOutputDevice()) == interface)
+        sender = gateway; // forwarded by the IP layer of RPF'(S): no relay tag names the previous hop
       Ipv4Address subnetBroadcast = GetLocalAddress(interface).GetSubnetDirectedBroadcast(
           m_ipv4->GetAddress(interface, 0).GetMask());
-      bool relay_packet_other = rtag && destination.Get() != subnetBroadcast.Get(); // has the relay tag and the destination is not this node
-      bool not_source_packet = !rtag && destination.IsMulticast() && gateway != source && !IsMyOwnAddress(gateway); // no relay tag and destination is multicast and was not issued by the source
+      bool relay_packet_other = rtag && destination.Get() != subnetBroadcast.Get()
+          && destination != GetLocalAddress(interface); // has the relay tag and the destination is not this node
+      bool not_source_packet = !rtag && destination.IsMulticast() && gateway != source && sender != gateway
+          && !IsMyOwnAddress(gateway); // no relay tag and destination is multicast and was not issued by the source
       if (relay_packet_other || not_source_packet)
         {
-          NS_LOG_INFO ("Drop packet "<< copy->GetUid()<< ", is for someone else [S:"<< source<<"; G:"<<gateway<<"; D:"<< destination << "] Tag: ["<< relayTag.m_sender << ","<<relayTag.m_receiver<<"]");
+          NS_LOG_INFO ("Drop packet "<< copy->GetUid()<< ", is for someone else [S:"<< source<<"; G:"<<gateway<<"; D:"<< destination << "] Tag: ["<< relay.sender << ","<<relay.receiver<<"]");
           return;
         }
+      m_admitted = AdmitData(SourceGroupPair(source, group), sourceHeader.GetIdentification(), interface, copy,
+          receivedPacket->GetSize());
+      m_admission = std::pair<DataPacketId, uint32_t>(
+          DataPacketId(SourceGroupPair(source, group), sourceHeader.GetIdentification()), interface);
+      if (!m_admitted)
+        return;
       SocketAddressTag satag;
       copy->RemovePacketTag(satag); // LOOK: it must be removed because will be added again by socket.
       NS_ASSERT(group.IsMulticast());
@@ -1910,7 +2345,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                     sgState->upstream.GraftPrune = GP_Pruned;
                     NS_LOG_INFO ("Node " << GetLocalAddress(interface)<< " RecvData GP_Forwarding -> GP_Pruned");
                     SendPruneBroadcast(interface, sgp, sender);
-                    UpdatePruneLimitTimer(sgp, interface, sender);
+                    UpdatePruneLimitTimer(sgState, Seconds(t_limit));
                   }
                 break;
               }
@@ -1920,7 +2355,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                   {
                     NS_LOG_INFO ("Node " << GetLocalAddress(interface)<< " RecvData GP_Pruned -> GP_Pruned");
                     SendPruneBroadcast(interface, sgp, sender);
-                    UpdatePruneLimitTimer(sgp, interface, sender);
+                    UpdatePruneLimitTimer(sgState, Seconds(t_limit));
                   }
                 break;
               }
@@ -1970,8 +2405,6 @@ MulticastRoutingProtocol::GetTypeId (void)
                 //	the TTL based on an implementation specific sampling policy to
                 //	avoid examining the TTL of every multicast packet it handles.
                 NS_LOG_INFO ("Node " << GetLocalAddress(interface)<< " RecvData Originator -> Originator");
-                if (sgState->upstream.SG_SAT.IsRunning())
-                  sgState->upstream.SG_SAT.Cancel();
                 UpdateSourceActiveTimer(sgp, interface, gateway);
                 double sample = UniformVariable().GetValue();
                 if (sample < TTL_SAMPLE && sourceHeader.GetTtl() > sgState->SG_DATA_TTL)
@@ -2008,7 +2441,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                     NS_LOG_INFO ("Node " << GetLocalAddress(interface)<< " RecvData Assert_NoInfo -> Assert_Winner");
                     UpdateAssertWinner(sgState, interface);
                     SendAssertBroadcast(interface, sender, sgp);
-                    UpdateAssertTimer(sgp, interface, sender);
+                    UpdateAssertTimer(sgState, Seconds(Assert_Time));
                   }
                 break;
               }
@@ -2024,7 +2457,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                     NS_LOG_INFO ("Node " << GetLocalAddress(interface)<< " RecvData Assert_Winner -> Assert_Winner");
                     UpdateAssertWinner(sgState, interface);
                     SendAssertBroadcast(interface, sender, sgp);
-                    UpdateAssertTimer(sgp, interface, sender);
+                    UpdateAssertTimer(sgState, Seconds(Assert_Time));
                   }
                 break;
               }
@@ -2079,7 +2512,7 @@ MulticastRoutingProtocol::GetTypeId (void)
             {
               NS_LOG_DEBUG ("RPF check failed: Sending Prune to "<< sender);
               SendPruneBroadcast(interface, sgp, sender); // limit the downstream prune.
-              UpdatePruneDownstreamTimer(sgp, (uint32_t) interface, sender);
+              UpdatePruneDownstreamTimer(sgState);
             }
           else
             NS_LOG_DEBUG ("RPF check failed: Should Send Prune to "<< sender<<" however, the Prune Limit Timer is active");
@@ -2089,57 +2522,86 @@ MulticastRoutingProtocol::GetTypeId (void)
       ///   Packets for which a route to the source cannot be found MUST be discarded.
       NS_LOG_DEBUG("Data forwarding towards > "<< fwd_list.size()<<" < interfaces/nodes ");
       GetPrinterList("Data forwarding list", fwd_list);
-      // Forward packet on all interfaces in oiflist.
-      WiredEquivalentInterface wei(m_hostInterface, m_hostAddress);
-      bool clients = (fwd_list.find(wei) != fwd_list.end());
-      fwd_list.erase(wei);
-      bool backbone = !fwd_list.empty();
-      if (backbone)
-        {
-          Time delay = TransmissionDelay(10, 250, Time::US);
-          Ptr<Packet> fwdPacket = copy->Copy(); // create a copy of the packet for each interface;
-          NS_LOG_INFO("DataFwd on backbone " << m_mainAddress << " interface "<<m_mainInterface << " Size " << fwdPacket->GetSize()<< " delay "<<delay.GetSeconds()<< " UID "<<fwdPacket->GetUid());
-          Simulator::Schedule(delay, &MulticastRoutingProtocol::SendPacketHBroadcastInterface, this, fwdPacket,
-              sourceHeader, m_mainInterface);
+      if (m_nativeForwarding)
+        {
+          // Other interfaces are served by RouteInput; the input link itself (wireless relay) is not IP-forwarded.
+          std::vector<uint32_t> outputs;
+          bool inputLink = false;
+          for (std::set<WiredEquivalentInterface>::const_iterator out = fwd_list.begin(); out != fwd_list.end(); out++)
+            {
+              if (out->first == interface)
+                inputLink = true;
+              else if (outputs.empty() || outputs.back() != out->first)
+                outputs.push_back(out->first);
+            }
+          if (outputs.empty())
+            RemoveMulticastRoute(source, group);
+          else
+            AddMulticastRoute(source, group, interface, outputs);
+          if (inputLink)
+            {
+              Time delay = ForwardingJitter(interface);
+              Simulator::Schedule(delay, &MulticastRoutingProtocol::SendPacketHBroadcastInterface, this, copy,
+                  sourceHeader, interface);
+            }
+          return;
         }
-      if (clients)
+      // Forward packet on all interfaces in oiflist, once per interface: the copies share the payload buffer.
+      std::set<WiredEquivalentInterface>::const_iterator out = fwd_list.begin();
+      while (out != fwd_list.end())
         {
-          Time delay = TransmissionDelay(10, 250, Time::US);
-          Ptr<Packet> fwdPacket = copy->Copy(); // create a copy of the packet for each interface;
-          NS_LOG_INFO("DataFwd on end-user " << m_hostAddress << " interface "<<m_hostInterface << " Size " << fwdPacket->GetSize()<< " delay "<<delay.GetSeconds()<< " UID "<<fwdPacket->GetUid());
+          // entries are sorted by interface: collect the downstream neighbors of the next one
+          uint32_t oif = out->first;
+          Ipv4Address local = GetLocalAddress(oif);
+          std::vector<Ipv4Address> receivers;
+          bool members = false;
+          for (; out != fwd_list.end() && out->first == oif; out++)
+            {
+              if (out->second == local)
+                members = true; // local members have no address to unicast to
+              else
+                receivers.push_back(out->second);
+            }
+          Time delay = ForwardingJitter(oif);
+          if (!members && !receivers.empty() && receivers.size() <= m_unicastRelayThreshold)
+            {
+              for (std::vector<Ipv4Address>::const_iterator rcv = receivers.begin(); rcv != receivers.end(); rcv++)
+                {
+                  Ptr<Packet> fwdPacket = copy->Copy();
+                  NS_LOG_INFO("DataFwd on " << local << " interface "<< oif << " to "<< *rcv << " Size " << fwdPacket->GetSize()<< " delay "<<delay.GetSeconds()<< " UID "<<fwdPacket->GetUid());
+                  Simulator::Schedule(delay, &MulticastRoutingProtocol::SendPacketHUnicastInterface, this, fwdPacket,
+                      sourceHeader, oif, *rcv);
+                }
+              continue;
+            }
+          Ptr<Packet> fwdPacket = copy->Copy();
+          NS_LOG_INFO("DataFwd on " << local << " interface "<< oif << " Size " << fwdPacket->GetSize()<< " delay "<<delay.GetSeconds()<< " UID "<<fwdPacket->GetUid());
           Simulator::Schedule(delay, &MulticastRoutingProtocol::SendPacketHBroadcastInterface, this, fwdPacket,
-              sourceHeader, m_hostInterface);
+              sourceHeader, oif);
         }
-//	for(std::set<WiredEquivalentInterface>::iterator out = fwd_list.begin(); out != fwd_list.end(); out++)//&& !(fwd_neighbors && fwd_clients) ; out++)
-//	{
-//		Ptr<Packet> fwdPacket = copy->Copy(); // create a copy of the packet for each interface;
-//		NS_LOG_INFO("DataFwd ("<<out->second <<", "<< out->first <<") interfaces/nodes "<< fwdPacket->GetSize()<< " delay "<<delay.GetSeconds()<< " UID "<<fwdPacket->GetUid());
-//		Simulator::Schedule(delay, &MulticastRoutingProtocol::SendPacketHBroadcastInterface, this, fwdPacket, sourceHeader, out->first);
-//		break;
-//	}
     }
 
     void
-    MulticastRoutingProtocol::RecvGraft (PIMHeader::GraftMessage &graft, Ipv4Address sender, Ipv4Address receiver,
+    MulticastRoutingProtocol::RecvGraft (JoinPruneGraftView &view, Ipv4Address sender, Ipv4Address receiver,
                                          uint32_t interface)
     {
       NS_LOG_FUNCTION(this << sender << receiver << interface);
-      for (std::vector<PIMHeader::MulticastGroupEntry>::iterator mgroup = graft.m_multicastGroups.begin();
-          mgroup != graft.m_multicastGroups.end(); mgroup++)
+      PIMHeader::GraftMessage graft; // header fields only, the groups are read from the view
+      graft.m_joinPruneMessage = view.GetMessage();
+      while (view.Next())
         {
-          for (std::vector<PIMHeader::EncodedSource>::iterator msource = mgroup->m_joinedSourceAddrs.begin();
-              msource != mgroup->m_joinedSourceAddrs.end(); msource++)
+          if (!view.IsJoin())
+            continue;
+          PIMHeader::EncodedGroup group = view.GetGroup();
+          const PIMHeader::EncodedSource &source = view.GetSource();
+          if (IsDownstream(interface, sender, source.m_sourceAddress, group.m_groupAddress))
             {
-              if (IsDownstream(interface, sender, msource->m_sourceAddress,
-                  mgroup->m_multicastGroupAddr.m_groupAddress))
-                {
-                  RecvGraftDownstream(graft, sender, receiver, *msource, mgroup->m_multicastGroupAddr, interface);
-                }
-              else
-                {
-                  SourceGroupPair sgp(msource->m_sourceAddress, mgroup->m_multicastGroupAddr.m_groupAddress, sender);
-                  RPFCheck(sgp);
-                }
+              RecvGraftDownstream(graft, sender, receiver, source, group, interface);
+            }
+          else
+            {
+              SourceGroupPair sgp(source.m_sourceAddress, group.m_groupAddress, sender);
+              RPFCheck(sgp);
             }
         }
     }
@@ -2279,6 +2741,14 @@ MulticastRoutingProtocol::GetTypeId (void)
                       {
                         if (sgState->upstream.SG_GRT.IsRunning())
                           sgState->upstream.SG_GRT.Cancel();
+                        NeighborState *ns = FindNeighborState(interface, sender, GetLocalAddress(interface));
+                        if (ns)
+                          {
+                            if (!sgState->upstream.graftSent.IsZero() && Simulator::Now() > sgState->upstream.graftSent)
+                              UpdateGraftRtt(ns, Simulator::Now() - sgState->upstream.graftSent);
+                            ns->neighborGraftRetry[0] = 0;
+                          }
+                        sgState->upstream.graftSent = Seconds(0);
                         sgState->upstream.GraftPrune = GP_Forwarding;
                         NS_LOG_INFO ("Node "<<GetLocalAddress(interface)<< " RecvGraftAck from " << sender << " GP_AckPending -> GP_Forwarding");
                         break;
@@ -2291,6 +2761,18 @@ MulticastRoutingProtocol::GetTypeId (void)
                     }
                 }				//TODO in case of fast changes we can add here a send prune to sender when !upstream
             }
+          // Acknowledged prune mode: pruned sources acknowledge our Prunes.
+          for (std::vector<PIMHeader::EncodedSource>::const_iterator iterSource = groups->m_prunedSourceAddrs.begin();
+              iterSource != groups->m_prunedSourceAddrs.end(); iterSource++)
+            {
+              SourceGroupPair sgp(iterSource->m_sourceAddress, groups->m_multicastGroupAddr.m_groupAddress, sender);
+              SourceGroupState *sgState = FindSourceGroupState(interface, sender, sgp);
+              if (!sgState || !sgState->upstream.valid)
+                continue;
+              NS_LOG_INFO ("Node "<<GetLocalAddress(interface)<< " RecvPruneAck from " << sender);
+              sgState->upstream.SG_PRT.Cancel();
+              sgState->upstream.pruneRetry = 0;
+            }
         }
     }
 
@@ -2310,7 +2792,7 @@ MulticastRoutingProtocol::GetTypeId (void)
 //   If the neighbor is downstream, the router MAY replay the last State Refresh message for any (S, G)
 //   pairs for which it is the Assert Winner indicating Prune and Assert status to the downstream router.
 //	 These State Refresh messages SHOULD be sent out immediately after the Hello message.
-      SourceGroupList sgList = m_IfaceSourceGroup.find(WiredEquivalentInterface(interface, neighbor))->second;
+      SourceGroupList &sgList = m_IfaceSourceGroup.find(TibKey(interface, neighbor))->second;
       Time srm = TransmissionDelay(hellos.GetDouble(), Triggered_Hello_Delay);
       NS_LOG_DEBUG("Stop @ 0; Start @ "<<delay.GetSeconds()<<"; Hello @ "<< hellos.GetSeconds()<<"; SRM @ "<<srm.GetSeconds());
       for (std::list<SourceGroupState>::iterator sgState = sgList.begin(); sgState != sgList.end(); sgState++)
@@ -2337,6 +2819,13 @@ MulticastRoutingProtocol::GetTypeId (void)
                                                              uint32_t interface)
     {
       NS_LOG_FUNCTION(this);
+      packet->AddHeader(message);
+      SendControlInterface(packet, interface);
+    }
+
+    void
+    MulticastRoutingProtocol::SendControlInterface (Ptr<Packet> packet, uint32_t interface)
+    {
       if (m_stopTx)
         return;
       // Send
@@ -2345,24 +2834,96 @@ MulticastRoutingProtocol::GetTypeId (void)
           NS_LOG_DEBUG("Interface "<<interface<<" is PIM-DISABLED");
           return;
         }
-      packet->AddHeader(message);
-      Ipv4Header ipv4header = BuildHeader(GetLocalAddress(interface), Ipv4Address(ALL_PIM_ROUTERS4),
+      InterfaceState *ifs = FindInterfaceState(interface);
+      if (!ifs || !ifs->socket || ifs->excluded)
+        {
+          NS_LOG_DEBUG("Interface "<<interface<<" has no PIM socket");
+          return;
+        }
+      Ipv4Header ipv4header = BuildHeader(ifs->address.GetLocal(), Ipv4Address(ALL_PIM_ROUTERS4),
           PIM_IP_PROTOCOL_NUM, packet->GetSize(), PIMDM_TTL, false);
       packet->AddHeader(ipv4header);
-      for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator i = m_socketAddresses.begin();
-          i != m_socketAddresses.end(); i++)
+      NS_LOG_DEBUG ("Node " << ifs->address.GetLocal()<< " is sending to "<< ifs->subnetBroadcast<<":"<<PIM_PORT_NUMBER<<", Socket "<< ifs->socket);
+      // Trace it
+      m_txControlPacketTrace(packet);
+      ifs->socket->SendTo(packet, 0, InetSocketAddress(ifs->subnetBroadcast, PIM_PORT_NUMBER));
+      if (ifs->neighborhood)
+        ifs->neighborhood->lastControlTx = Simulator::Now();
+    }
+
+    void
+    MulticastRoutingProtocol::QueueControl (uint32_t interface, const PIMHeader &message, Time delay)
+    {
+      NS_LOG_FUNCTION(this << interface << delay.GetSeconds());
+      if (!m_controlQueue)
         {
-          if ((uint32_t) m_ipv4->GetInterfaceForDevice(i->first->GetBoundNetDevice()) == interface
-              && !i->second.GetLocal().IsMulticast())
+          Simulator::Schedule(delay, &MulticastRoutingProtocol::SendPacketPIMRoutersInterface, this,
+              Create<Packet>(), message, interface);
+          return;
+        }
+      Ptr<Packet> packet = Create<Packet>();
+      packet->AddHeader(message);
+      QueueControlPacket(interface, packet, delay);
+    }
+
+    void
+    MulticastRoutingProtocol::QueueControlPacket (uint32_t interface, Ptr<Packet> packet, Time delay)
+    {
+      if (!m_controlQueue)
+        {
+          Simulator::Schedule(delay, &MulticastRoutingProtocol::SendControlInterface, this, packet, interface);
+          return;
+        }
+      InterfaceState *ifs = FindInterfaceState(interface);
+      if (!ifs || !ifs->socket || ifs->excluded)
+        {
+          NS_LOG_DEBUG("Interface "<<interface<<" has no PIM socket");
+          return;
+        }
+      // drop the message if an identical one is still waiting on the interface
+      uint32_t size = packet->GetSize();
+      std::vector<uint8_t> bytes(size), pending(size);
+      packet->CopyData(&bytes[0], size);
+      for (std::list<Ptr<Packet> >::const_iterator iter = ifs->controlQueue.begin(); iter != ifs->controlQueue.end();
+          iter++)
+        {
+          if ((*iter)->GetSize() != size)
+            continue;
+          (*iter)->CopyData(&pending[0], size);
+          if (pending == bytes)
             {
-              Ipv4Address bcast = i->second.GetLocal().GetSubnetDirectedBroadcast(i->second.GetMask());
-              NS_LOG_DEBUG ("Node " << GetLocalAddress(interface)<< " is sending to "<< bcast<<":"<<PIM_PORT_NUMBER<<", Socket "<< i->first);
-              // Trace it
-              m_txControlPacketTrace(packet);
-              i->first->SendTo(packet, 0, InetSocketAddress(bcast, PIM_PORT_NUMBER));
-              break;
+              NS_LOG_DEBUG("Interface "<<interface<<": same message already queued");
+              return;
             }
         }
+      ifs->controlQueue.push_back(packet);
+      if (!ifs->controlDrain.IsRunning())
+        ifs->controlDrain = Simulator::Schedule(delay, &MulticastRoutingProtocol::ControlQueueDrain, this, interface);
+    }
+
+    void
+    MulticastRoutingProtocol::ControlQueueDrain (uint32_t interface)
+    {
+      NS_LOG_FUNCTION(this << interface);
+      InterfaceState *ifs = FindInterfaceState(interface);
+      if (!ifs)
+        return;
+      // without pacing the whole queue leaves in this event, otherwise one message per ControlPacing
+      while (!ifs->controlQueue.empty())
+        {
+          Ptr<Packet> packet = ifs->controlQueue.front();
+          ifs->controlQueue.pop_front();
+          SendControlInterface(packet, interface);
+          if (!m_controlPacing.IsZero())
+            break;
+        }
+      if (!ifs->controlQueue.empty())
+        {
+          ifs->controlDrain = Simulator::Schedule(m_controlPacing, &MulticastRoutingProtocol::ControlQueueDrain, this,
+              interface);
+          if (m_controlPriority)
+            ifs->controlBusy = Max(ifs->controlBusy, Simulator::Now() + Seconds(m_controlPacing.GetSeconds() * ifs->controlQueue.size()));
+        }
     }
 
     void
@@ -2380,23 +2941,18 @@ MulticastRoutingProtocol::GetTypeId (void)
         {
           AskRoute(destination);
         }
-      Ipv4Address local = GetLocalAddress(interface);
+      InterfaceState *ifs = FindInterfaceState(interface);
       // Send
-      for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator i = m_socketAddresses.begin();
-          i != m_socketAddresses.end(); i++)
+      if (ifs && ifs->socket)
         {
-          if (local == i->second.GetLocal())
-            {
-              Ptr<Packet> copy = packet->Copy();
-              Ipv4Header ipv4Header = BuildHeader(i->second.GetLocal(), destination, PIM_IP_PROTOCOL_NUM,
-                  copy->GetSize(), 1, false);
-              copy->AddHeader(ipv4Header);
-              NS_LOG_DEBUG ("Node " << local << " is sending packet "<<copy <<"("<<copy->GetSize() << ") to Destination: " << destination << ":"<<PIM_PORT_NUMBER<<", Interface "<<interface<<", Socket "<<i->first);
-              // Trace it
-              m_txControlPacketTrace(copy);
-              i->first->SendTo(copy, 0, InetSocketAddress(destination, PIM_PORT_NUMBER));
-              break;
-            }
+          Ipv4Address local = ifs->address.GetLocal();
+          Ptr<Packet> copy = packet->Copy();
+          Ipv4Header ipv4Header = BuildHeader(local, destination, PIM_IP_PROTOCOL_NUM, copy->GetSize(), 1, false);
+          copy->AddHeader(ipv4Header);
+          NS_LOG_DEBUG ("Node " << local << " is sending packet "<<copy <<"("<<copy->GetSize() << ") to Destination: " << destination << ":"<<PIM_PORT_NUMBER<<", Interface "<<interface<<", Socket "<<ifs->socket);
+          // Trace it
+          m_txControlPacketTrace(copy);
+          ifs->socket->SendTo(copy, 0, InetSocketAddress(destination, PIM_PORT_NUMBER));
         }
     }
 
@@ -2412,18 +2968,13 @@ MulticastRoutingProtocol::GetTypeId (void)
       if (wei.first == UINT_MAX)
         AskRoute(destination);
       uint32_t interface = wei.first != UINT_MAX ? wei.first : m_ipv4->GetInterfaceForAddress(m_mainAddress);
-      Ipv4Address local = GetLocalAddress(interface);
-      for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator i = m_socketAddresses.begin();
-          i != m_socketAddresses.end(); i++)
+      InterfaceState *ifs = FindInterfaceState(interface);
+      if (ifs && ifs->socket)
         {
-          if (local == i->second.GetLocal())
-            {
-              Ptr<Packet> copy = packet->Copy();
-              NS_LOG_DEBUG ("Node " << local << " is sending packet "<<copy <<"("<<copy->GetSize() << ") to Destination: " << destination << ", Interface "<<interface<<", Socket "<<i->first);
-              m_txDataPacketTrace(copy);
-              i->first->SendTo(copy, 0, InetSocketAddress(destination, PIM_PORT_NUMBER));
-              break;
-            }
+          Ptr<Packet> copy = packet->Copy();
+          NS_LOG_DEBUG ("Node " << ifs->address.GetLocal() << " is sending packet "<<copy <<"("<<copy->GetSize() << ") to Destination: " << destination << ", Interface "<<interface<<", Socket "<<ifs->socket);
+          m_txDataPacketTrace(copy);
+          ifs->socket->SendTo(copy, 0, InetSocketAddress(destination, PIM_PORT_NUMBER));
         }
     }
 
@@ -2435,23 +2986,73 @@ MulticastRoutingProtocol::GetTypeId (void)
       if (m_stopTx)
         return;
       // Send it ***
-      for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator i = m_socketAddresses.begin();
-          i != m_socketAddresses.end(); i++)
+      InterfaceState *ifs = FindInterfaceState(interface);
+      if (!ifs)
+        return;
+      SendPacketHRelayInterface(packet, ipv4Header, interface, ifs->address.GetBroadcast());
+    }
+
+    void
+    MulticastRoutingProtocol::SendPacketHUnicastInterface (Ptr<Packet> packet, Ipv4Header &ipv4Header,
+                                                           uint32_t interface, Ipv4Address receiver)
+    {
+      NS_LOG_FUNCTION(this << interface << receiver);
+      if (m_stopTx)
+        return;
+      SendPacketHRelayInterface(packet, ipv4Header, interface, receiver);
+    }
+
+    void
+    MulticastRoutingProtocol::SendPacketHRelayInterface (Ptr<Packet> packet, Ipv4Header &ipv4Header,
+                                                         uint32_t interface, Ipv4Address receiver)
+    {
+      InterfaceState *ifs = FindInterfaceState(interface);
+      if (!ifs || !ifs->socket || ifs->excluded)
         {
-          NS_LOG_DEBUG("Interface " << m_ipv4->GetInterfaceForAddress(i->second.GetLocal ())<<", Local "<<i->second.GetLocal()<<", Broad "<<i->second.GetBroadcast()<<", Mask "<<i->second.GetMask());
-          if (GetLocalAddress(interface) == i->second.GetLocal())
-            {
-              packet->AddHeader(ipv4Header);
-              RelayTag relayTag;
-              relayTag.m_sender = i->second.GetLocal();
-              relayTag.m_receiver = i->second.GetBroadcast();
-              m_txDataPacketTrace(packet);
-              packet->AddPacketTag(relayTag);
-              NS_LOG_DEBUG ("Node " << GetObject<Node> ()->GetId() << " is forwarding packet " << packet->GetUid() <<"("<<packet->GetSize() << ") to Destination "<< ipv4Header.GetDestination() << " ("<< relayTag.m_receiver<<") " <<", Interface "<< interface<< ", Pid "<< packet->GetUid()<<", Socket "<<i->first);
-              i->first->SendTo(packet, 0, InetSocketAddress(i->second.GetBroadcast()));
-              break; // Just to speedup and avoid the complete loop over all sockets.
-            }
+          NS_LOG_DEBUG("Interface "<<interface<<" has no PIM socket");
+          return;
+        }
+      if (m_controlPriority && (ifs->controlBusy > Simulator::Now() || !ifs->heldRelays.empty()))
+        { // a control message is about to leave on this interface: do not queue data ahead of it
+          HeldRelay held;
+          held.packet = packet;
+          held.header = ipv4Header;
+          held.receiver = receiver;
+          ifs->heldRelays.push_back(held);
+          if (!ifs->relayRelease.IsRunning())
+            ifs->relayRelease = Simulator::Schedule(
+                Max(ifs->controlBusy - Simulator::Now(), Seconds(0)) + TransmissionDelay(10, 250, Time::US),
+                &MulticastRoutingProtocol::ReleaseHeldRelays, this, interface);
+          return;
+        }
+      NS_LOG_DEBUG("Interface " << interface<<", Local "<<ifs->address.GetLocal()<<", Broad "<<ifs->address.GetBroadcast()<<", Mask "<<ifs->address.GetMask());
+      packet->AddHeader(ipv4Header);
+      RelayTag relayTag;
+      relayTag.m_sender = ifs->address.GetLocal();
+      relayTag.m_receiver = receiver;
+      m_txDataPacketTrace(packet);
+      packet->AddPacketTag(relayTag);
+      NS_LOG_DEBUG ("Node " << GetObject<Node> ()->GetId() << " is forwarding packet " << packet->GetUid() <<"("<<packet->GetSize() << ") to Destination "<< ipv4Header.GetDestination() << " ("<< relayTag.m_receiver<<") " <<", Interface "<< interface<< ", Pid "<< packet->GetUid()<<", Socket "<<ifs->socket);
+      ifs->socket->SendTo(packet, 0, InetSocketAddress(receiver));
+    }
+
+    void
+    MulticastRoutingProtocol::ReleaseHeldRelays (uint32_t interface)
+    {
+      InterfaceState *ifs = FindInterfaceState(interface);
+      if (!ifs)
+        return;
+      if (ifs->controlBusy > Simulator::Now())
+        { // more control messages were scheduled meanwhile
+          ifs->relayRelease = Simulator::Schedule(ifs->controlBusy - Simulator::Now() + TransmissionDelay(10, 250, Time::US),
+              &MulticastRoutingProtocol::ReleaseHeldRelays, this, interface);
+          return;
         }
+      // the whole busy window leaves in one event, in arrival order
+      std::list<HeldRelay> held;
+      held.swap(ifs->heldRelays);
+      for (std::list<HeldRelay>::iterator iter = held.begin(); iter != held.end(); iter++)
+        SendPacketHRelayInterface(iter->packet, iter->header, interface, iter->receiver);
     }
 
     bool
@@ -2507,6 +3108,12 @@ MulticastRoutingProtocol::GetTypeId (void)
                                               Ipv4Address receivingIfaceAddr)
     {
       NS_LOG_FUNCTION(this);
+      NeighborState *ns = FindNeighborState(interface, neighborIfaceAddr, receivingIfaceAddr);
+      if (ns && ns->neighborRefresh + ns->neighborHoldTime > Simulator::Now())
+        { // refreshed meanwhile
+          ns->neigborNLT.Schedule(ns->neighborRefresh + ns->neighborHoldTime - Simulator::Now());
+          return;
+        }
       SourceGroupList *sgList = FindSourceGroupList(interface, neighborIfaceAddr); // get all the S, G pair
       for (SourceGroupList::iterator sgState = sgList->begin(); sgState != sgList->end(); sgState++)
         {
@@ -2556,7 +3163,7 @@ MulticastRoutingProtocol::GetTypeId (void)
           if (sgState->upstream.valid)
             {					//TODO double check, see above
               sgState->upstream.SG_OT.Cancel();
-              UpdateOverrideTimer(sgp, interface, Seconds(Graft_Retry_Period), gateway);
+              UpdateOverrideTimer(sgState, Seconds(Graft_Retry_Period));
             }
           Simulator::Schedule(Seconds(Graft_Retry_Period), &MulticastRoutingProtocol::OTTimerExpire, this, sgp,
               interface, gateway);
@@ -2599,6 +3206,23 @@ MulticastRoutingProtocol::GetTypeId (void)
       sgState->upstream.SG_OT.Cancel();
     }
 
+    void
+    MulticastRoutingProtocol::PRTTimerExpire (SourceGroupPair &sgp, uint32_t interface, Ipv4Address destination)
+    {
+      NS_LOG_FUNCTION(this);
+      SourceGroupState *sgState = FindSourceGroupState(interface, destination, sgp);
+      NS_ASSERT(sgState);
+      // The Prune is no longer relevant: a Graft or a Join moved the Upstream(S, G) state machine.
+      if (sgState->upstream.GraftPrune != GP_Pruned || sgState->upstream.pruneRetry >= MaxPruneRetry)
+        {
+          sgState->upstream.pruneRetry = 0;
+          return;
+        }
+      sgState->upstream.pruneRetry++;
+      NS_LOG_INFO ("Node "<< GetLocalAddress(interface)<< " Prune to "<< destination<< " not acknowledged, retry "<<(uint16_t)sgState->upstream.pruneRetry);
+      SendPruneBroadcast(interface, sgp, destination);
+    }
+
     void
     MulticastRoutingProtocol::GRTTimerExpire (SourceGroupPair &sgp, uint32_t interface, Ipv4Address destination)
     {
@@ -2629,6 +3253,7 @@ MulticastRoutingProtocol::GetTypeId (void)
               {		//increase counter retries
                 ns->neighborGraftRetry[0]++;
                 SendGraftBroadcast(interface, destination, sgp);
+                sgState->upstream.graftSent = Seconds(0); // an Ack to a retransmitted Graft is not a valid RTT sample
                 sgState->upstream.SG_GRT.Cancel();
                 UpdateGraftTimer(sgp, interface, destination);
               }
@@ -2685,9 +3310,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                 CreateMulticastGroupEntry(mge, ForgeEncodedGroup(sgp.groupMulticastAddr));
                 AddMulticastGroupSourcePrune(mge, ForgeEncodedSource(sgp.sourceMulticastAddr));
                 AddMulticastGroupEntry(prune, mge);
-                Ptr<Packet> packet = Create<Packet>();
-                Simulator::Schedule(TransmissionDelay(), &MulticastRoutingProtocol::SendPacketPIMRoutersInterface, this,
-                    packet, prune, interface);
+                QueueControl(interface, prune, ControlJitter(interface));
                 //	Its purpose is to add additional reliability so that if a Join that should have
                 //	overridden the Prune is lost locally on the LAN, the PruneEcho(S, G) may be received
                 //	and trigger a new Join message.
@@ -2790,9 +3413,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                     ForgeStateRefresh(interface, destination, sgp, refresh);
                     refresh.GetStateRefreshMessage().m_P = (
                         IsDownstream(interface, destination, sgp) && (sgState->PruneState == Prune_Pruned) ? 1 : 0);
-                    Ptr<Packet> packet = Create<Packet>();
-                    Simulator::Schedule(TransmissionDelay(), &MulticastRoutingProtocol::SendPacketPIMRoutersInterface,
-                        this, packet, refresh, interface);
+                    QueueControl(interface, refresh, ControlJitter(interface));
                     break;
                   }
                 default:
@@ -2802,6 +3423,8 @@ MulticastRoutingProtocol::GetTypeId (void)
                   }
                 }
             }
+          if (TibKey(interface, destination).second != destination)
+            break; // shared entry: one State Refresh for the whole link
         }
     }
 
@@ -2857,6 +3480,12 @@ MulticastRoutingProtocol::GetTypeId (void)
     MulticastRoutingProtocol::SATTimerExpire (SourceGroupPair &sgp, uint32_t interface, Ipv4Address destination)
     {
       SourceGroupState *sgState = FindSourceGroupState(interface, destination, sgp);
+      Time deadline = sgState->upstream.sourceActive + sgState->upstream.SG_SAT.GetDelay();
+      if (sgState->upstream.valid && deadline > Simulator::Now())
+        { // data from S arrived meanwhile
+          sgState->upstream.SG_SAT.Schedule(deadline - Simulator::Now());
+          return;
+        }
       if (sgState->upstream.valid)
         {
           switch (sgState->upstream.origination)
@@ -2873,6 +3502,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                 if (sgState->upstream.SG_SRT.IsRunning())
                   sgState->upstream.SG_SRT.Cancel();
                 sgState->upstream.origination = NotOriginator;
+                RemoveStateRefreshTemplates(sgp);
                 break;
               }
             default:
@@ -2953,9 +3583,7 @@ MulticastRoutingProtocol::GetTypeId (void)
             CreateMulticastGroupEntry(mge, ForgeEncodedGroup(sgp.groupMulticastAddr));
             AddMulticastGroupSourcePrune(mge, ForgeEncodedSource(sgp.sourceMulticastAddr));
             AddMulticastGroupEntry(msg, mge);
-            Ptr<Packet> packet = Create<Packet>();
-            Simulator::Schedule(TransmissionDelay(), &MulticastRoutingProtocol::SendPacketPIMRoutersInterface, this,
-                packet, msg, wei.first);
+            QueueControl(wei.first, msg, ControlJitter(wei.first));
             UpdatePruneLimitTimer(sgp, wei.first, wei.second);
             break;
           }
@@ -3096,6 +3724,7 @@ MulticastRoutingProtocol::GetTypeId (void)
               sgState->upstream.SG_SRT.Cancel();
             if (sgState->upstream.SG_SAT.IsRunning())
               sgState->upstream.SG_SAT.Cancel();
+            RemoveStateRefreshTemplates(sgp);
             break;
           }
         default:
@@ -3181,10 +3810,12 @@ MulticastRoutingProtocol::GetTypeId (void)
     }
 
     void
-    MulticastRoutingProtocol::RecvJP (PIMHeader::JoinPruneMessage &jp, Ipv4Address sender, Ipv4Address receiver,
+    MulticastRoutingProtocol::RecvJP (JoinPruneGraftView &view, Ipv4Address sender, Ipv4Address receiver,
                                       uint32_t interface)
     {
-      NS_LOG_FUNCTION(this << sender << receiver << interface << jp.m_joinPruneMessage.m_upstreamNeighborAddr.m_unicastAddress);
+      NS_LOG_FUNCTION(this << sender << receiver << interface << view.GetMessage().m_upstreamNeighborAddr.m_unicastAddress);
+      PIMHeader::JoinPruneMessage jp; // header fields only, the groups are read from the view
+      jp.m_joinPruneMessage = view.GetMessage();
 //	NS_LOG_DEBUG("Node  "<<receiver <<" receives JP from "<<sender);
 //	uint16_t groups = jp.m_joinPruneMessage.m_numGroups;
       //TODO check if used Time HoldTime = jp.m_joinPruneMessage.m_holdTime;
@@ -3194,16 +3825,14 @@ MulticastRoutingProtocol::GetTypeId (void)
 //	   field set to the router's address on I.  The Prune(S,G)
 //	   Downstream state machine on interface I MUST transition to the
 //	   NoInfo (NI) state.  The PrunePending Timer (PPT(S,G,I)) MUST be cancelled.
-      for (std::vector<PIMHeader::MulticastGroupEntry>::iterator iter = jp.m_multicastGroups.begin();
-          iter != jp.m_multicastGroups.end(); iter++)
+      while (view.Next())
         {				///<Section 4.4.1.
-          NS_LOG_DEBUG("Join = "<<iter->m_numberJoinedSources<<", Prune = "<<iter->m_numberPrunedSources);
-          //JOIN sources' addresses
-          for (std::vector<PIMHeader::EncodedSource>::iterator iterJoin = iter->m_joinedSourceAddrs.begin();
-              iterJoin != iter->m_joinedSourceAddrs.end(); iterJoin++)
+          PIMHeader::EncodedGroup group = view.GetGroup();
+          if (view.IsJoin())
             {
               // Upstream state machine
-              RecvJoin(jp, sender, receiver, interface, *iterJoin, iter->m_multicastGroupAddr);
+              RecvJoin(jp, sender, receiver, interface, view.GetSource(), group);
+              continue;
             }
           //PRUNE
 //		A Prune(S,G) is received on interface I with the upstream
@@ -3214,14 +3843,10 @@ MulticastRoutingProtocol::GetTypeId (void)
 //			one neighbor on I.  If the router has only one neighbor on
 //			interface I, then it SHOULD set the PPT(S,G,I) to zero,
 //			effectively transitioning immediately to the Pruned (P) state.
-          for (std::vector<PIMHeader::EncodedSource>::iterator iterPrune = iter->m_prunedSourceAddrs.begin();
-              iterPrune != iter->m_prunedSourceAddrs.end(); iterPrune++)
-            {
-              //This timer is set when a Prune(S, G) is received on the upstream interface where olist(S, G) != NULL.
-              //	When the timer expires, a Join(S, G) message is sent on the upstream interface.  This timer
-              //	is normally set to t_override (see 4.8).
-              RecvPrune(jp, sender, receiver, interface, *iterPrune, iter->m_multicastGroupAddr);
-            }
+          //This timer is set when a Prune(S, G) is received on the upstream interface where olist(S, G) != NULL.
+          //	When the timer expires, a Join(S, G) message is sent on the upstream interface.  This timer
+          //	is normally set to t_override (see 4.8).
+          RecvPrune(jp, sender, receiver, interface, view.GetSource(), group);
         }
     }
 
@@ -3309,8 +3934,7 @@ MulticastRoutingProtocol::GetTypeId (void)
             //	The Upstream(S, G) state machine remains in Forwarding (F) state.
             if (GetNextHop(source.m_sourceAddress) != source.m_sourceAddress && !sgState->upstream.SG_OT.IsRunning())
               {
-                Time delay = Seconds(t_override(interface));
-                UpdateOverrideTimer(sgp, interface, delay, upstream);
+                UpdateOverrideTimer(sgState, Seconds(t_override(interface)));
               }
             break;
           }
@@ -3324,7 +3948,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                 && jp.m_joinPruneMessage.m_holdTime > sgState->upstream.SG_PLT.GetDelay())
               {
                 sgState->upstream.SG_PLT.Cancel();
-                UpdatePruneLimitTimer(sgp, interface, jp.m_joinPruneMessage.m_holdTime, sender);
+                UpdatePruneLimitTimer(sgState, jp.m_joinPruneMessage.m_holdTime);
               }
             break;
           }
@@ -3337,8 +3961,7 @@ MulticastRoutingProtocol::GetTypeId (void)
             //	The Upstream(S, G) state machine remains in AckPending (AP) state.
             if (!sgState->upstream.SG_OT.IsRunning())
               {
-                Time delay = Seconds(t_override(interface));
-                UpdateOverrideTimer(sgp, interface, delay, upstream);
+                UpdateOverrideTimer(sgState, Seconds(t_override(interface)));
               }
             break;
           }
@@ -3360,6 +3983,15 @@ MulticastRoutingProtocol::GetTypeId (void)
       SourceGroupPair sgp(source.m_sourceAddress, group.m_groupAddress, sender);
       SourceGroupState *sgState = FindSourceGroupState(interface, sender, sgp, true);
       NS_LOG_INFO ("Node "<<GetLocalAddress(interface)<< " RecvPrune from downstream " << sender<< " "<< sgState->upstream.GraftPrune);
+      if (m_pruneAck && IsMyOwnAddress(jp.m_joinPruneMessage.m_upstreamNeighborAddr.m_unicastAddress))
+        SendPruneAckBroadcast(interface, sender, sgp);
+      bool shared = TibKey(interface, sender).second != sender;
+      if (shared && IsMyOwnAddress(jp.m_joinPruneMessage.m_upstreamNeighborAddr.m_unicastAddress))
+        { // the link of the sender leaves prunes (S,G) once the interface is Pruned
+          if (sgState->PruneState == Prune_NoInfo)
+            sgState->prunedNeighbors.clear();
+          sgState->prunedNeighbors.insert(sender);
+        }
       switch (sgState->PruneState)
         {
         case Prune_NoInfo:
@@ -3381,14 +4013,21 @@ MulticastRoutingProtocol::GetTypeId (void)
                     sgState->PruneState = Prune_Pruned;
                     NS_LOG_INFO ("Node "<<GetLocalAddress(interface)<< " RecvPrune from downstream Prune_NoInfo -> Prune_Pruned");
                   }
-                if (nstatus->neighbors.size() > 1)
+                if (nstatus->neighbors.size() > 1 && shared)
+                  {
+                    // the shared entry covers every link on the interface: J/P_Override_Interval (I).
+                    // Kept whole even if density aware: downstream routers size t_override from their own
+                    // neighbors and delays, only the full interval covers every override Join on the LAN.
+                    delay = nstatus->overrideInterval + nstatus->propagationDelay;
+                  }
+                else if (nstatus->neighbors.size() > 1)
                   {
                     // since we have a per-neighbor-link we can trigger the PrunePendingTimer almost immediately
                     // because the PPT affects just that link (pair interface-neighbor), not the set of links on that interface
                     delay = TransmissionDelay();
                   }NS_LOG_INFO ("Node "<<GetLocalAddress(interface)<< " RecvPrune from downstream " << sender<< " "<< sgState->upstream.GraftPrune
                     << " Neighbor size "<< nstatus->neighbors.size()<< " PPTTimerExpire in "<<delay.GetSeconds()<<"sec");
-                UpdatePrunePendingTimer(sgp, interface, delay, sender);
+                UpdatePrunePendingTimer(sgState, delay);
               }
             break;
           }
@@ -3409,7 +4048,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                 NS_LOG_INFO ("Node "<<GetLocalAddress(interface)<< " RecvPrune from downstream Prune_Pruned -> Prune_Pruned");
                 if (jp.m_joinPruneMessage.m_holdTime > sgState->SG_PT.GetDelay())
                   {
-                    UpdatePruneTimer(sgp, interface, jp.m_joinPruneMessage.m_holdTime, sender);
+                    UpdatePruneTimer(sgState, jp.m_joinPruneMessage.m_holdTime);
                   }
               }
             break;
@@ -3465,6 +4104,19 @@ MulticastRoutingProtocol::GetTypeId (void)
                                         PIMHeader::EncodedGroup &group)
     {
       NS_LOG_FUNCTION(this<<sender<<receiver<<interface<<source.m_sourceAddress<<group.m_groupAddress);
+      Ipv4Address upstream = jp.m_joinPruneMessage.m_upstreamNeighborAddr.m_unicastAddress;
+      if (sender != upstream && !IsMyOwnAddress(upstream)
+          && IsUpstream(interface, upstream, source.m_sourceAddress, group.m_groupAddress))
+        {
+          // Another downstream router sent a Join to our RPF'(S): it overrides the Prune already, suppress ours.
+          SourceGroupPair sgpUp(source.m_sourceAddress, group.m_groupAddress, upstream);
+          SourceGroupState *sgStateUp = FindSourceGroupState(interface, upstream, sgpUp);
+          if (sgStateUp && sgStateUp->upstream.SG_OT.IsRunning())
+            {
+              NS_LOG_INFO ("Node "<<GetLocalAddress(interface)<< " overheard Join from "<< sender << " to "<< upstream<< ", cancel OT");
+              sgStateUp->upstream.SG_OT.Cancel();
+            }
+        }
       if (IsUpstream(interface, sender, source.m_sourceAddress, group.m_groupAddress))
         RecvJoinUpstream(jp, sender, receiver, interface, source, group);
       else
@@ -3645,7 +4297,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                 sgState->AssertState = Assert_Winner;
                 UpdateAssertWinner(sgState, myMetric);
                 SendAssertBroadcast(interface, sender, sgp);
-                UpdateAssertTimer(sgp, interface, sender);
+                UpdateAssertTimer(sgState, Seconds(Assert_Time));
                 NS_LOG_INFO ("Node " << GetLocalAddress(interface) << " NoInfo -> Winner");
               }
             else
@@ -3661,7 +4313,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                 //	received State Refresh Interval.
                 sgState->AssertState = Assert_Loser;
                 UpdateAssertWinner(sgState, received);
-                UpdateAssertTimer(sgp, interface, sender);
+                UpdateAssertTimer(sgState, Seconds(Assert_Time));
                 NS_LOG_INFO ("Node " << GetLocalAddress(interface) << " NoInfo -> Loser");
                 if (couldAssert)
                   {
@@ -3676,9 +4328,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                     AddMulticastGroupSourcePrune(mge, ForgeEncodedSource(assert.m_sourceAddr.m_unicastAddress));
                     AddMulticastGroupEntry(prune, mge);
                     prune.GetJoinPruneMessage().m_joinPruneMessage.m_holdTime = sgState->SG_AT.GetDelay();
-                    Ptr<Packet> packet = Create<Packet>();
-                    Simulator::Schedule(TransmissionDelay(), &MulticastRoutingProtocol::SendPacketPIMRoutersInterface,
-                        this, packet, prune, interface);
+                    QueueControl(interface, prune, ControlJitter(interface));
                     UpstreamStateMachine(sgp);
                     NS_LOG_INFO ("Node " << GetLocalAddress(interface) << " SendPrune to " << sender);
                   }
@@ -3699,10 +4349,8 @@ MulticastRoutingProtocol::GetTypeId (void)
                 ForgeAssertMessage(interface, sender, assertR, sgp);
                 assertR.GetAssertMessage().m_metricPreference = sgState->AssertWinner.metricPreference;
                 assertR.GetAssertMessage().m_metric = sgState->AssertWinner.routeMetric;
-                Ptr<Packet> packet = Create<Packet>();
-                Simulator::Schedule(TransmissionDelay(), &MulticastRoutingProtocol::SendPacketPIMRoutersInterface, this,
-                    packet, assertR, interface);
-                UpdateAssertTimer(sgp, interface, sender);
+                QueueControl(interface, assertR, ControlJitter(interface));
+                UpdateAssertTimer(sgState, Seconds(Assert_Time));
                 NS_LOG_INFO ("Node " << GetLocalAddress(interface) << " Winner -> Winner");
               }
             else
@@ -3721,7 +4369,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                 //   Upstream(S,G) state machine.
                 sgState->AssertState = Assert_Loser;
                 UpdateAssertWinner(sgState, received);
-                UpdateAssertTimer(sgp, interface, sender);
+                UpdateAssertTimer(sgState, Seconds(Assert_Time));
                 NS_LOG_INFO ("Node " << GetLocalAddress(interface) << " Winner -> Loser");
                 //TODO previously commented out
                 PIMHeader prune;
@@ -3731,10 +4379,8 @@ MulticastRoutingProtocol::GetTypeId (void)
                 AddMulticastGroupSourcePrune(mge, ForgeEncodedSource(assert.m_sourceAddr.m_unicastAddress));
                 AddMulticastGroupEntry(prune, mge);
                 prune.GetJoinPruneMessage().m_joinPruneMessage.m_holdTime = sgState->SG_AT.GetDelay();
-                Ptr<Packet> packet = Create<Packet>();
                 NS_LOG_INFO ("Node " << GetLocalAddress(interface) << " SendPrune to " << sender);
-                Simulator::Schedule(TransmissionDelay(), &MulticastRoutingProtocol::SendPacketPIMRoutersInterface, this,
-                    packet, prune, interface);
+                QueueControl(interface, prune, ControlJitter(interface));
                 UpstreamStateMachine(sgp);
               }
             break;
@@ -3776,7 +4422,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                 //	CouldAssert(S, G, I) == TRUE, the router MUST multicast a
                 //	Prune(S, G) to the new Assert winner.
                 sgState->AssertState = Assert_Loser;
-                UpdateAssertTimer(sgp, interface, sender);
+                UpdateAssertTimer(sgState, Seconds(Assert_Time));
                 UpdateAssertWinner(sgState, assert.m_metricPreference, assert.m_metric, sender);
                 NS_LOG_INFO ("Node " << GetLocalAddress(interface) << " Winner -> Loser");
                 if (couldAssert)
@@ -3789,9 +4435,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                     AddMulticastGroupEntry(prune, mge);
                     prune.GetJoinPruneMessage().m_joinPruneMessage.m_holdTime = sgState->SG_AT.GetDelay();
                     NS_LOG_INFO ("Node " << GetLocalAddress(interface) << " SendPrune to " << sender);
-                    Ptr<Packet> packet = Create<Packet>();
-                    Simulator::Schedule(TransmissionDelay(), &MulticastRoutingProtocol::SendPacketPIMRoutersInterface,
-                        this, packet, prune, interface);
+                    QueueControl(interface, prune, ControlJitter(interface));
                   }
               }
             break;
@@ -3876,13 +4520,13 @@ MulticastRoutingProtocol::GetTypeId (void)
                 if (refresh.m_P == 0 && !sgState->upstream.SG_PLT.IsRunning())
                   {
                     SendPruneBroadcast(interface, sgp, sender);
-                    UpdatePruneLimitTimer(sgp, interface, sender);
+                    UpdatePruneLimitTimer(sgState, Seconds(t_limit));
                   }
                 else if (refresh.m_P)
                   {
                     if (sgState->upstream.SG_PLT.IsRunning())
                       sgState->upstream.SG_PLT.Cancel();
-                    UpdatePruneLimitTimer(sgp, interface, sender);
+                    UpdatePruneLimitTimer(sgState, Seconds(t_limit));
                   }
                 break;
               }
@@ -3929,7 +4573,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                 sgState->AssertState = Assert_Winner;
                 UpdateAssertWinner(sgState, interface);
                 SendAssertBroadcast(interface, sender, sgp);
-                UpdateAssertTimer(sgp, interface, sender);
+                UpdateAssertTimer(sgState, Seconds(Assert_Time));
               }
             else
               {
@@ -3945,7 +4589,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                 sgState->AssertState = Assert_Loser;
                 UpdateAssertWinner(sgState, refresh.m_metricPreference, refresh.m_metric,
                     refresh.m_originatorAddr.m_unicastAddress);
-                UpdateAssertTimer(sgp, interface, Seconds(3 * RefreshInterval), sender);
+                UpdateAssertTimer(sgState, Seconds(3 * RefreshInterval));
                 if (CouldAssert(refresh.m_sourceAddr.m_unicastAddress, refresh.m_multicastGroupAddr.m_groupAddress,
                     interface, sender))
                   {
@@ -3960,9 +4604,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                     AddMulticastGroupSourcePrune(mge, ForgeEncodedSource(refresh.m_sourceAddr.m_unicastAddress));
                     AddMulticastGroupEntry(msg, mge);
                     msg.GetJoinPruneMessage().m_joinPruneMessage.m_holdTime = sgState->SG_AT.GetDelay();
-                    Ptr<Packet> packet = Create<Packet>();
-                    Simulator::Schedule(TransmissionDelay(), &MulticastRoutingProtocol::SendPacketPIMRoutersInterface,
-                        this, packet, msg, interface);
+                    QueueControl(interface, msg, ControlJitter(interface));
                     UpstreamStateMachine(sgp);
                   }
               }
@@ -3985,10 +4627,8 @@ MulticastRoutingProtocol::GetTypeId (void)
                 ForgeAssertMessage(interface, sender, assertR, sgp);
                 assertR.GetAssertMessage().m_metricPreference = sgState->AssertWinner.metricPreference;
                 assertR.GetAssertMessage().m_metric = sgState->AssertWinner.routeMetric;
-                Ptr<Packet> packet = Create<Packet>();
-                Simulator::Schedule(TransmissionDelay(), &MulticastRoutingProtocol::SendPacketPIMRoutersInterface, this,
-                    packet, assertR, interface);
-                UpdateAssertTimer(sgp, interface, sender);
+                QueueControl(interface, assertR, ControlJitter(interface));
+                UpdateAssertTimer(sgState, Seconds(Assert_Time));
               }
             else
               {
@@ -4004,7 +4644,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                 sgState->AssertState = Assert_Loser;
                 UpdateAssertWinner(sgState, refresh.m_metricPreference, refresh.m_metric,
                     refresh.m_originatorAddr.m_unicastAddress);
-                UpdateAssertTimer(sgp, interface, sender);
+                UpdateAssertTimer(sgState, Seconds(Assert_Time));
                 //The router MUST also
                 //	multicast a Prune(S, G) to the Assert winner, with a Prune Hold
                 //	Time equal to the Assert Timer, and evaluate any changes in its
@@ -4016,9 +4656,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                 AddMulticastGroupSourcePrune(mge, ForgeEncodedSource(refresh.m_sourceAddr.m_unicastAddress));
                 AddMulticastGroupEntry(prune, mge);
                 prune.GetJoinPruneMessage().m_joinPruneMessage.m_holdTime = sgState->SG_AT.GetDelay();
-                Ptr<Packet> packet = Create<Packet>();
-                Simulator::Schedule(TransmissionDelay(), &MulticastRoutingProtocol::SendPacketPIMRoutersInterface, this,
-                    packet, prune, interface);
+                QueueControl(interface, prune, ControlJitter(interface));
                 UpstreamStateMachine(sgp);
               }
             break;
@@ -4064,7 +4702,7 @@ MulticastRoutingProtocol::GetTypeId (void)
 //				sgState->SG_AT.SetFunction(&MulticastRoutingProtocol::ATTimerExpire, this);
 //				sgState->SG_AT.SetArguments(sgp, interface, sender);
 //				sgState->SG_AT.Schedule();
-                UpdateAssertTimer(sgp, interface, sender);
+                UpdateAssertTimer(sgState, Seconds(Assert_Time));
                 UpdateAssertWinner(sgState, refresh.m_metricPreference, refresh.m_metric,
                     refresh.m_originatorAddr.m_unicastAddress);
                 if (CouldAssert(refresh.m_sourceAddr.m_unicastAddress, refresh.m_multicastGroupAddr.m_groupAddress,
@@ -4078,9 +4716,7 @@ MulticastRoutingProtocol::GetTypeId (void)
                     CreateMulticastGroupEntry(mge, ForgeEncodedGroup(refresh.m_multicastGroupAddr.m_groupAddress));
                     AddMulticastGroupSourcePrune(mge, ForgeEncodedSource(refresh.m_sourceAddr.m_unicastAddress));
                     AddMulticastGroupEntry(prune, mge);
-                    Ptr<Packet> packet = Create<Packet>();
-                    Simulator::Schedule(TransmissionDelay(), &MulticastRoutingProtocol::SendPacketPIMRoutersInterface,
-                        this, packet, prune, interface);
+                    QueueControl(interface, prune, ControlJitter(interface));
                   }
               }
             break;
@@ -4175,9 +4811,7 @@ MulticastRoutingProtocol::GetTypeId (void)
           //set Assert Override of SRMP' to 1;
           //set Assert Override of SRMP' to 0;
           //transmit SRMP' on I;
-          Ptr<Packet> packet;
-          Simulator::Schedule(TransmissionDelay(), &MulticastRoutingProtocol::SendPacketPIMRoutersInterface, this,
-              packet, refreshFRW, i_nbrs->first);
+          QueueControl(i_nbrs->first, refreshFRW, ControlJitter(i_nbrs->first));
         }
     }
 
@@ -4199,11 +4833,7 @@ MulticastRoutingProtocol::GetTypeId (void)
             }
           InsertNeighborState(interface, sender, receiver);
           ns = FindNeighborState(interface, sender, receiver);
-          // If a Hello message is received from a new neighbor, the receiving router SHOULD send its own Hello message
-          //    after a random delay between 0 and Triggered_Hello_Delay.
-          Time delay = Seconds(UniformVariable().GetValue(0, Triggered_Hello_Delay));
-          Simulator::Schedule(delay, &MulticastRoutingProtocol::SendHelloReply, this, interface, sender);
-          NS_LOG_DEBUG("Neighbors = "<< nst->neighbors.size() << ", reply at "<<(Simulator::Now()+delay).GetSeconds());
+          TriggerHello(interface, sender);
           SourceGroupList *sgl = FindSourceGroupList(interface, sender);
           if (!sgl)
             InsertSourceGroupList(interface, sender);
@@ -4225,10 +4855,16 @@ MulticastRoutingProtocol::GetTypeId (void)
                     EraseNeighborState(interface, *ns);
                     break;
                   default:
-                    if (ns->neigborNLT.IsRunning())
+                    // NLT re-arms itself for the time left when it fires: only a shorter Hold Time needs a new event
+                    ns->neighborRefresh = Simulator::Now();
+                    ns->neighborHoldTime = value;
+                    if (ns->neigborNLT.IsRunning() && value < ns->neigborNLT.GetDelayLeft())
                       ns->neigborNLT.Cancel();
-                    ns->neigborNLT.SetDelay(value);
-                    ns->neigborNLT.Schedule();
+                    if (!ns->neigborNLT.IsRunning())
+                      {
+                        ns->neigborNLT.SetDelay(value);
+                        ns->neigborNLT.Schedule();
+                      }
                     if (ns->neighborTimeoutB)
                       ns->neighborTimeout += value;
                   }
@@ -4349,6 +4985,8 @@ MulticastRoutingProtocol::GetTypeId (void)
     {
       NS_LOG_FUNCTION(this);
       m_interfaceExclusions = exceptions;
+      for (uint32_t i = 0; i < m_interfaces.size(); i++)
+        m_interfaces[i].excluded = m_interfaceExclusions.find(i) != m_interfaceExclusions.end();
     }
 
     std::set<uint32_t>
@@ -4395,19 +5033,55 @@ MulticastRoutingProtocol::GetTypeId (void)
     {
       NS_LOG_FUNCTION(this<<interface<<neighbor<<sgp.sourceMulticastAddr<<sgp.groupMulticastAddr);
       NS_ASSERT(interface >0 && interface <m_ipv4->GetNInterfaces());
+      WiredEquivalentInterface key = TibKey(interface, neighbor);
       SourceGroupState sgs(sgp);
-      sgs.SGPair.nextMulticastAddr = neighbor;
+      sgs.SGPair.nextMulticastAddr = key.second;
       sgs.LocalMembership = Local_NoInfo;
       sgs.PruneState = Prune_NoInfo;
       sgs.AssertState = Assert_NoInfo;
-      sgs.upstream.valid = IsUpstream(interface, neighbor, sgp);
-      WiredEquivalentInterface key(interface, neighbor);
+      sgs.upstream.valid = (key.second == neighbor ? IsUpstream(interface, neighbor, sgp)
+          : RPF_interface(sgp.sourceMulticastAddr).first == interface);
       SourceGroupList sgl;
       std::pair<WiredEquivalentInterface, SourceGroupList> k_pair(key, sgl);
       m_IfaceSourceGroup.insert(k_pair);
       NS_ASSERT(m_IfaceSourceGroup.find(key) != m_IfaceSourceGroup.end());
       m_IfaceSourceGroup.find(key)->second.push_front(sgs);
       NS_ASSERT(!m_IfaceSourceGroup.find(key)->second.empty());
+      BindSourceGroupTimers(&m_IfaceSourceGroup.find(key)->second.front(), interface, neighbor);
+    }
+
+    void
+    MulticastRoutingProtocol::BindSourceGroupTimers (SourceGroupState *sgState, uint32_t interface, Ipv4Address neighbor)
+    {
+      // List elements never move: timers are bound once, updates only set the delay and schedule.
+      SourceGroupPair &sgp = sgState->SGPair;
+      Ipv4Address gateway = neighbor;
+      if (TibKey(interface, neighbor).second != neighbor)
+        { // shared entry: downstream timers stand for the whole link, upstream ones for RPF'(S)
+          neighbor = Ipv4Address::GetAny();
+          if (RPF_interface(sgp.sourceMulticastAddr).first == interface)
+            gateway = RPF_interface(sgp.sourceMulticastAddr).second;
+        }
+      sgState->SG_AT.SetFunction(&MulticastRoutingProtocol::ATTimerExpire, this);
+      sgState->SG_AT.SetArguments(sgp, interface, neighbor);
+      sgState->SG_PT.SetFunction(&MulticastRoutingProtocol::PTTimerExpire, this);
+      sgState->SG_PT.SetArguments(sgp, interface, neighbor);
+      sgState->SG_PPT.SetFunction(&MulticastRoutingProtocol::PPTTimerExpire, this);
+      sgState->SG_PPT.SetArguments(sgp, interface, neighbor);
+      sgState->SG_PLTD.SetFunction(&MulticastRoutingProtocol::PLTTimerExpireDownstream, this);
+      sgState->SG_PLTD.SetArguments(sgp, interface, neighbor);
+      sgState->upstream.SG_GRT.SetFunction(&MulticastRoutingProtocol::GRTTimerExpire, this);
+      sgState->upstream.SG_GRT.SetArguments(sgp, interface, gateway);
+      sgState->upstream.SG_OT.SetFunction(&MulticastRoutingProtocol::OTTimerExpire, this);
+      sgState->upstream.SG_OT.SetArguments(sgp, interface, gateway);
+      sgState->upstream.SG_PLT.SetFunction(&MulticastRoutingProtocol::PLTTimerExpire, this);
+      sgState->upstream.SG_PLT.SetArguments(sgp, interface, gateway);
+      sgState->upstream.SG_SAT.SetFunction(&MulticastRoutingProtocol::SATTimerExpire, this);
+      sgState->upstream.SG_SAT.SetArguments(sgp, interface, gateway);
+      sgState->upstream.SG_SRT.SetFunction(&MulticastRoutingProtocol::SRTTimerExpire, this);
+      sgState->upstream.SG_SRT.SetArguments(sgp, interface);
+      sgState->upstream.SG_PRT.SetFunction(&MulticastRoutingProtocol::PRTTimerExpire, this);
+      sgState->upstream.SG_PRT.SetArguments(sgp, interface, gateway);
     }
 
     SourceGroupState*
@@ -4482,15 +5156,27 @@ MulticastRoutingProtocol::GetTypeId (void)
     {
       NS_LOG_FUNCTION(this<<interface<<neighbor);
       std::map<WiredEquivalentInterface, SourceGroupList>::iterator iter = m_IfaceSourceGroup.find(
-          WiredEquivalentInterface(interface, neighbor));
+          TibKey(interface, neighbor));
       return (iter == m_IfaceSourceGroup.end() ? NULL : &iter->second);
     }
 
+    WiredEquivalentInterface
+    MulticastRoutingProtocol::TibKey (uint32_t interface, Ipv4Address neighbor)
+    {
+      if (!m_sharedMediumTib)
+        return WiredEquivalentInterface(interface, neighbor);
+      Ptr<NetDevice> device = m_ipv4->GetNetDevice(interface);
+      if (!device->IsBroadcast() || device->IsPointToPoint())
+        return WiredEquivalentInterface(interface, neighbor);
+      // one entry for all the neighbors on the link, as the per-interface state of RFC 3973
+      return WiredEquivalentInterface(interface, Ipv4Address::GetAny());
+    }
+
     void
     MulticastRoutingProtocol::InsertSourceGroupList (uint32_t interface, Ipv4Address neighbor)
     {
       NS_LOG_FUNCTION(this<<interface<<neighbor);
-      WiredEquivalentInterface i_n(interface, neighbor);
+      WiredEquivalentInterface i_n = TibKey(interface, neighbor);
       std::map<WiredEquivalentInterface, SourceGroupList>::iterator iter = m_IfaceSourceGroup.find(i_n);
       if (iter != m_IfaceSourceGroup.end())
         return;
@@ -4523,8 +5209,7 @@ MulticastRoutingProtocol::GetTypeId (void)
     NeighborhoodStatus*
     MulticastRoutingProtocol::FindNeighborhoodStatus (uint32_t interface)
     {
-      std::map<uint32_t, NeighborhoodStatus>::iterator iter = m_IfaceNeighbors.find(interface);
-      return (iter == m_IfaceNeighbors.end() ? NULL : &(iter->second));
+      return (interface < m_interfaces.size() ? m_interfaces[interface].neighborhood : NULL);
     }
 
     void
@@ -4534,6 +5219,7 @@ MulticastRoutingProtocol::GetTypeId (void)
         {
           NeighborhoodStatus is;
           m_IfaceNeighbors.insert(std::pair<uint32_t, NeighborhoodStatus>(interface, is));
+          InsertInterfaceState(interface).neighborhood = &m_IfaceNeighbors.find(interface)->second;
         }
     }
 
@@ -4544,9 +5230,10 @@ MulticastRoutingProtocol::GetTypeId (void)
       NS_ASSERT(iter != m_IfaceNeighbors.end());
       NeighborhoodStatus *ns = &(m_IfaceNeighbors.find(interface)->second);
       NS_ASSERT(ns != NULL);
-      ns->hello_timer.Remove();
+      ns->triggeredHello.Cancel();
       for (std::list<NeighborState>::iterator iter = ns->neighbors.begin(); iter != ns->neighbors.end(); iter++)
         iter->neigborNLT.Remove();
+      m_interfaces[interface].neighborhood = NULL;
       m_IfaceNeighbors.erase(interface);
     }
 
@@ -4602,7 +5289,7 @@ MulticastRoutingProtocol::GetTypeId (void)
           neighborState->neigborNLT.SetArguments(interface, neighbor, local);
           neighborState->neighborCreation = Simulator::Now();
           neighborState->neighborHoldTime = Seconds(Hold_Time_Default);
-          neighborState->neighborRefresh = Seconds(Hello_Period);
+          neighborState->neighborRefresh = Simulator::Now();
           neighborState->neighborTimeout = Seconds(Hello_Period); // todo check here
           neighborState->neighborTimeoutB = true;
           NS_LOG_FUNCTION(this<<interface<<neighbor<<local);
@@ -4656,26 +5343,70 @@ MulticastRoutingProtocol::GetTypeId (void)
     void
     MulticastRoutingProtocol::EnablePimInterface (uint32_t interface)
     {
-      if (m_IfacePimEnabled.find(interface) == m_IfacePimEnabled.end())
-        m_IfacePimEnabled.insert(std::pair<uint32_t, bool>(interface, true));
-      else
-        m_IfacePimEnabled.find(interface)->second = true;
+      InsertInterfaceState(interface).pimEnabled = true;
     }
 
     void
     MulticastRoutingProtocol::DisablePimInterface (uint32_t interface)
     {
-      if (m_IfacePimEnabled.find(interface) == m_IfacePimEnabled.end())
-        m_IfacePimEnabled.insert(std::pair<uint32_t, bool>(interface, false));
-      else
-        m_IfacePimEnabled.find(interface)->second = false;
+      InsertInterfaceState(interface).pimEnabled = false;
+      RemoveStateRefreshTemplates(interface);
     }
 
     bool
     MulticastRoutingProtocol::GetPimInterface (uint32_t interface)
     {
-      if (m_IfacePimEnabled.find(interface) != m_IfacePimEnabled.end())
-        return m_IfacePimEnabled.find(interface)->second;
+      return interface < m_interfaces.size() && m_interfaces[interface].pimEnabled;
+    }
+
+    void
+    MulticastRoutingProtocol::AddMulticastRoute (Ipv4Address source, Ipv4Address group, uint32_t inputInterface,
+                                                 std::vector<uint32_t> outputInterfaces)
+    {
+      NS_LOG_FUNCTION(this<<source<<group<<inputInterface);
+      SourceGroupPair sgp(source, group);
+      std::map<SourceGroupPair, Ptr<Ipv4MulticastRoute> >::const_iterator iter = m_nativeRoutes.find(sgp);
+      if (iter != m_nativeRoutes.end() && iter->second->GetParent() == inputInterface)
+        { // refreshed on every data packet: keep the route while the olist is unchanged
+          std::map<uint32_t, uint32_t> ttls = iter->second->GetOutputTtlMap();
+          bool unchanged = ttls.size() == outputInterfaces.size();
+          for (std::vector<uint32_t>::const_iterator oif = outputInterfaces.begin();
+              unchanged && oif != outputInterfaces.end(); oif++)
+            unchanged = ttls.find(*oif) != ttls.end();
+          if (unchanged)
+            return;
+        }
+      Ptr<Ipv4MulticastRoute> route = Create<Ipv4MulticastRoute>();
+      route->SetGroup(group);
+      route->SetOrigin(source);
+      route->SetParent(inputInterface);
+      for (std::vector<uint32_t>::const_iterator oif = outputInterfaces.begin(); oif != outputInterfaces.end(); oif++)
+        route->SetOutputTtl(*oif, Ipv4MulticastRoute::MAX_TTL - 1);
+      m_nativeRoutes[sgp] = route;
+    }
+
+    void
+    MulticastRoutingProtocol::RemoveMulticastRoute (Ipv4Address source, Ipv4Address group)
+    {
+      m_nativeRoutes.erase(SourceGroupPair(source, group));
+    }
+
+    bool
+    MulticastRoutingProtocol::IsDuplicate (const DataPacketId &id)
+    {
+      Time now = Simulator::Now();
+      // expire the oldest entries first: the list is in arrival order
+      while (!m_duplicateOrder.empty()
+          && (m_duplicates.size() >= m_duplicateCacheSize
+              || m_duplicates[m_duplicateOrder.front()] + m_duplicateLifetime <= now))
+        {
+          m_duplicates.erase(m_duplicateOrder.front());
+          m_duplicateOrder.pop_front();
+        }
+      if (m_duplicates.find(id) != m_duplicates.end())
+        return true;
+      m_duplicates.insert(std::pair<DataPacketId, Time>(id, now));
+      m_duplicateOrder.push_back(id);
       return false;
     }
 
@@ -4720,6 +5451,77 @@ MulticastRoutingProtocol::GetTypeId (void)
       return m_stopTx;
     }
 
+    bool
+    MulticastRoutingProtocol::AdmitData (const SourceGroupPair &sgp, uint16_t identification, uint32_t interface,
+                                         Ptr<const Packet> packet, uint32_t size)
+    {
+      if (m_duplicateCacheSize && IsDuplicate(DataPacketId(sgp, identification)))
+        {
+          NS_LOG_INFO ("Drop packet ("<< sgp.sourceMulticastAddr<<", "<< sgp.groupMulticastAddr<<", "<< identification<<"), duplicate");
+          return false;
+        }
+      if (m_policerRate.GetBitRate() && !PolicerConform(sgp, interface, size))
+        {
+          NS_LOG_INFO ("Drop packet ("<< sgp.sourceMulticastAddr<<", "<< sgp.groupMulticastAddr<<", "<< identification<<"), above the policed rate on "<< interface);
+          m_policerDropTrace(packet);
+          return false;
+        }
+      return true;
+    }
+
+    bool
+    MulticastRoutingProtocol::PolicerConform (const SourceGroupPair &sgp, uint32_t interface, uint32_t size)
+    {
+      // a bucket idle long enough to refill is the same as a new one: forget it
+      Time refill = Seconds(m_policerBurst * 8.0 / m_policerRate.GetBitRate());
+      if (Simulator::Now() - m_policerSweep >= Max(refill, Seconds(1)))
+        {
+          m_policerSweep = Simulator::Now();
+          for (std::map<std::pair<SourceGroupPair, uint32_t>, TokenBucket>::iterator iter = m_policers.begin();
+              iter != m_policers.end();)
+            {
+              if (Simulator::Now() - iter->second.last >= refill)
+                m_policers.erase(iter++);
+              else
+                iter++;
+            }
+        }
+      std::pair<SourceGroupPair, uint32_t> key(sgp, interface);
+      std::map<std::pair<SourceGroupPair, uint32_t>, TokenBucket>::iterator bucket = m_policers.find(key);
+      if (bucket == m_policers.end())
+        { // a new flow starts with a full bucket
+          bucket = m_policers.insert(std::pair<std::pair<SourceGroupPair, uint32_t>, TokenBucket>(key, TokenBucket())).first;
+          bucket->second.tokens = m_policerBurst;
+          bucket->second.last = Simulator::Now();
+        }
+      TokenBucket &tb = bucket->second;
+      tb.tokens = std::min((double) m_policerBurst,
+          tb.tokens + (Simulator::Now() - tb.last).GetSeconds() * m_policerRate.GetBitRate() / 8);
+      tb.last = Simulator::Now();
+      if (tb.tokens < size)
+        {
+          tb.dropped++;
+          m_policerDrops++;
+          return false;
+        }
+      tb.tokens -= size;
+      return true;
+    }
+
+    uint32_t
+    MulticastRoutingProtocol::GetPolicerDrops () const
+    {
+      return m_policerDrops;
+    }
+
+    uint32_t
+    MulticastRoutingProtocol::GetPolicerDrops (Ipv4Address source, Ipv4Address group, uint32_t interface) const
+    {
+      std::map<std::pair<SourceGroupPair, uint32_t>, TokenBucket>::const_iterator bucket = m_policers.find(
+          std::pair<SourceGroupPair, uint32_t>(SourceGroupPair(source, group), interface));
+      return (bucket == m_policers.end() ? 0 : bucket->second.dropped);
+    }
+
     bool
     MulticastRoutingProtocol::GetMulticastGroup (Ipv4Address group)
     {
@@ -4733,6 +5535,7 @@ MulticastRoutingProtocol::GetTypeId (void)
         {
           m_mrib.find(group)->second.mgroup.clear();
           m_mrib.erase(group);
+          m_outputRoutes.clear();
         }
     }
 
@@ -4773,6 +5576,7 @@ MulticastRoutingProtocol::GetTypeId (void)
       ipv4header.SetProtocol(protocol);
       ipv4header.SetPayloadSize(payloadSize);
       ipv4header.SetTtl((ttl > 0 ? ttl : 1));
+      ipv4header.SetTos(m_controlTos);
       if (mayFragment)
         {
           ipv4header.SetMayFragment();
@@ -4805,7 +5609,20 @@ MulticastRoutingProtocol::GetTypeId (void)
     double
     MulticastRoutingProtocol::t_override (uint32_t interface)
     {
-      return UniformVariable().GetValue(0, OverrideInterval(interface));
+      return UniformVariable().GetValue(0, OverrideWindow(interface));
+    }
+
+    double
+    MulticastRoutingProtocol::OverrideWindow (uint32_t interface)
+    {
+      double oi = OverrideInterval(interface);
+      if (!m_densityAwareOverride)
+        return oi;
+      NeighborhoodStatus *ns = FindNeighborhoodStatus(interface);
+      // Neighbors other than the upstream one may override the same Prune: spreading them one propagation delay
+      // apart lets the first Join suppress the others.
+      size_t overriders = ns->neighbors.size() > 1 ? ns->neighbors.size() - 1 : 1;
+      return std::min(oi, overriders * ns->propagationDelay.GetSeconds());
     }
 
     double
@@ -4948,7 +5765,15 @@ MulticastRoutingProtocol::GetTypeId (void)
     MulticastRoutingProtocol::AskRoute (Ipv4Address destination)
     {
       //TODO: We don't know the next hop towards the source: first node finds it, then it relies packets.
-      Simulator::Schedule(TransmissionDelay(), &MulticastRoutingProtocol::AskRoutez, this, destination);
+      std::map<Ipv4Address, PendingRoute>::iterator pending = m_pendingRoutes.find(destination);
+      if (pending == m_pendingRoutes.end())
+        pending = m_pendingRoutes.insert(std::pair<Ipv4Address, PendingRoute>(destination, PendingRoute(m_routeProbeBackoff))).first;
+      if (pending->second.probe.IsRunning())
+        {
+          NS_LOG_DEBUG("Route lookup towards "<< destination<<" already pending, retry "<< pending->second.retries);
+          return;
+        }
+      pending->second.probe = Simulator::Schedule(TransmissionDelay(), &MulticastRoutingProtocol::AskRoutez, this, destination);
     }
 
     void
@@ -4958,30 +5783,75 @@ MulticastRoutingProtocol::GetTypeId (void)
       NS_LOG_FUNCTION(this<< destination);
       if (m_stopTx)
         return;
+      Ptr<Ipv4Route> route = GetRoute(destination);
+      if (route && isValidGateway(route->GetGateway()))
+        return RouteResolved(destination);
+      std::map<Ipv4Address, PendingRoute>::iterator pending = m_pendingRoutes.find(destination);
+      if (pending != m_pendingRoutes.end())
+        {
+          if (pending->second.retries >= m_routeProbeRetries)
+            {
+              NS_LOG_DEBUG("No route towards "<< destination<<" after "<< pending->second.retries<<" probes, dropping "<<pending->second.packets.size()<<" packets");
+              m_pendingRoutes.erase(pending);
+              return;
+            }
+          pending->second.retries++;
+          pending->second.probe = Simulator::Schedule(pending->second.backoff, &MulticastRoutingProtocol::AskRoutez, this, destination);
+          pending->second.backoff = pending->second.backoff + pending->second.backoff;
+        }
       PIMHeader msg;
       Ptr<Packet> packet = Create<Packet>(); //forge a hello reply
       uint32_t interface = m_ipv4->GetInterfaceForAddress(m_mainAddress);
       ForgeHelloMessage(interface, msg);
       packet->AddHeader(msg);
       // Trace it
-      Ipv4Address local = GetLocalAddress(interface);
-      for (std::map<Ptr<Socket>, Ipv4InterfaceAddress>::const_iterator i = m_socketAddresses.begin();
-          i != m_socketAddresses.end(); i++)
+      InterfaceState *ifs = FindInterfaceState(interface);
+      if (ifs && ifs->socket)
         {
-          if (local == i->second.GetLocal())
-            {
-              Ipv4Header ipv4Header = BuildHeader(i->second.GetLocal(), destination, PIM_IP_PROTOCOL_NUM,
-                  packet->GetSize(), 1, false);
-              packet->AddHeader(ipv4Header);
-              m_txControlRouteTrace(packet);
-              NS_LOG_DEBUG ("Node " << local << " is sending packet "<<packet <<"("<<packet->GetSize() << ") to Destination: " << destination << ":"<<PIM_PORT_NUMBER<<", Interface "<<interface<<", Socket "<<i->first);
-//              m_txControlPacketTrace (copy);
-              i->first->SendTo(packet, 0, InetSocketAddress(destination, PIM_PORT_NUMBER));
-              break;
-            }
+          Ipv4Address local = ifs->address.GetLocal();
+          Ipv4Header ipv4Header = BuildHeader(local, destination, PIM_IP_PROTOCOL_NUM, packet->GetSize(), 1, false);
+          packet->AddHeader(ipv4Header);
+          m_txControlRouteTrace(packet);
+          NS_LOG_DEBUG ("Node " << local << " is sending packet "<<packet <<"("<<packet->GetSize() << ") to Destination: " << destination << ":"<<PIM_PORT_NUMBER<<", Interface "<<interface<<", Socket "<<ifs->socket);
+//          m_txControlPacketTrace (copy);
+          ifs->socket->SendTo(packet, 0, InetSocketAddress(destination, PIM_PORT_NUMBER));
         }
     }
 
+    void
+    MulticastRoutingProtocol::EnqueuePendingData (Ipv4Address source, Ptr<Packet> packet, Ipv4Address sender,
+                                                  uint16_t port, uint32_t interface, const RelayInfo &relay)
+    {
+      NS_LOG_FUNCTION(this<< source << packet->GetUid());
+      if (m_routeProbeQueueLen == 0)
+        return;
+      std::map<Ipv4Address, PendingRoute>::iterator pending = m_pendingRoutes.find(source);
+      if (pending == m_pendingRoutes.end())
+        pending = m_pendingRoutes.insert(std::pair<Ipv4Address, PendingRoute>(source, PendingRoute(m_routeProbeBackoff))).first;
+      if (pending->second.packets.size() >= m_routeProbeQueueLen)
+        {
+          NS_LOG_DEBUG("Queue towards "<< source<< " full, drop packet "<< pending->second.packets.front().packet->GetUid());
+          pending->second.packets.pop_front();
+        }
+      pending->second.packets.push_back(PendingDataPacket(packet, sender, port, interface, relay));
+    }
+
+    void
+    MulticastRoutingProtocol::RouteResolved (Ipv4Address destination)
+    {
+      NS_LOG_FUNCTION(this<< destination);
+      std::map<Ipv4Address, PendingRoute>::iterator pending = m_pendingRoutes.find(destination);
+      if (pending == m_pendingRoutes.end())
+        return;
+      std::list<PendingDataPacket> packets;
+      packets.swap(pending->second.packets);
+      pending->second.probe.Cancel();
+      m_pendingRoutes.erase(pending);
+      NS_LOG_DEBUG("Route towards "<< destination<< " resolved, replaying "<< packets.size()<< " packets");
+      for (std::list<PendingDataPacket>::iterator iter = packets.begin(); iter != packets.end(); iter++)
+        RecvPIMData(iter->packet, iter->sender, iter->port, iter->interface, iter->relay);
+    }
+
 /// \brief There are receivers for the given SourceGroup pair.
 /// \param sgp source-group pair.
 /// \return True if there are receivers interested in, false otherwise.
@@ -5029,7 +5899,7 @@ MulticastRoutingProtocol::GetTypeId (void)
       SourceGroupPair sgp(source, group);
       for (uint32_t i = 0; i < m_ipv4->GetNInterfaces(); i++)
         {
-          if (IsLoopInterface(i))
+          if (IsLoopInterface(i) || IsExcluded(i))
             continue;
           if (local_receiver_include(source, group, i))
             {
@@ -5098,10 +5968,10 @@ MulticastRoutingProtocol::GetTypeId (void)
       std::set<WiredEquivalentInterface> pimNbrs;
       for (uint32_t i = 0; i < m_ipv4->GetNInterfaces(); i++)
         {
-          if (IsLoopInterface(i) || m_IfaceNeighbors.find(i) == m_IfaceNeighbors.end())
+          NeighborhoodStatus *nstatus = FindNeighborhoodStatus(i);
+          if (IsLoopInterface(i) || !nstatus || IsExcluded(i))
             continue;
-          for (NeighborList::iterator iter = m_IfaceNeighbors.find(i)->second.neighbors.begin();
-              iter != m_IfaceNeighbors.find(i)->second.neighbors.end(); iter++)
+          for (NeighborList::iterator iter = nstatus->neighbors.begin(); iter != nstatus->neighbors.end(); iter++)
             pimNbrs.insert(WiredEquivalentInterface(i, iter->neighborIfaceAddr));
         }
       return pimNbrs;
@@ -5116,22 +5986,31 @@ MulticastRoutingProtocol::GetTypeId (void)
     {
       std::set<WiredEquivalentInterface> prune;
       SourceGroupPair sgp(source, group);
-      for (uint32_t i = 0; i < m_ipv4->GetNInterfaces(); i++)
+      for (std::map<WiredEquivalentInterface, SourceGroupList>::iterator iter = m_IfaceSourceGroup.begin();
+          iter != m_IfaceSourceGroup.end(); iter++)
         {
+          uint32_t i = iter->first.first;
           if (IsLoopInterface(i))
             continue;
-          for (std::map<WiredEquivalentInterface, SourceGroupList>::iterator iter = m_IfaceSourceGroup.begin();
-              iter != m_IfaceSourceGroup.end(); iter++)
+          SourceGroupState *sgState = FindSourceGroupState(i, iter->first.second, sgp);
+          if (!sgState || sgState->PruneState != Prune_Pruned)
+            continue;
+          if (!m_sharedMediumTib || iter->first.second != Ipv4Address::GetAny())
             {
-              if (i != iter->first.first)
-                continue;
-              SourceGroupState *sgState = FindSourceGroupState(iter->first.first, iter->first.second, sgp);
-              if (!sgState)
-                continue;
-              if (IsDownstream(iter->first.first, iter->first.second, sgp) && sgState->PruneState == Prune_Pruned)
-                {
-                  prune.insert(iter->first);
-                }
+              if (IsDownstream(i, iter->first.second, sgp))
+                prune.insert(iter->first);
+              continue;
+            }
+          // shared entry: expand to the links of the pruning neighbors, all of them if none recorded
+          NeighborhoodStatus *nstatus = FindNeighborhoodStatus(i);
+          if (!nstatus)
+            continue;
+          for (NeighborList::iterator nb = nstatus->neighbors.begin(); nb != nstatus->neighbors.end(); nb++)
+            {
+              if (IsDownstream(i, nb->neighborIfaceAddr, sgp)
+                  && (sgState->prunedNeighbors.empty()
+                      || sgState->prunedNeighbors.find(nb->neighborIfaceAddr) != sgState->prunedNeighbors.end()))
+                prune.insert(WiredEquivalentInterface(i, nb->neighborIfaceAddr));
             }
         }
       return prune;
@@ -5148,20 +6027,26 @@ MulticastRoutingProtocol::GetTypeId (void)
     {
       std::set<WiredEquivalentInterface> set;
       SourceGroupPair sgp(source, group);
-      for (uint32_t i = 0; i < m_ipv4->GetNInterfaces(); i++)
+      for (std::map<WiredEquivalentInterface, SourceGroupList>::iterator iter = m_IfaceSourceGroup.begin();
+          iter != m_IfaceSourceGroup.end(); iter++)
         {
-          if (IsLoopInterface(i))
+          uint32_t i = iter->first.first;
+          if (IsLoopInterface(i) || !FindSourceGroupState(i, iter->first.second, sgp))
             continue;
-          for (std::map<WiredEquivalentInterface, SourceGroupList>::iterator iter = m_IfaceSourceGroup.begin();
-              iter != m_IfaceSourceGroup.end(); iter++)
+          if (!m_sharedMediumTib || iter->first.second != Ipv4Address::GetAny())
             {
-              if (i != iter->first.first)
-                continue;
-              SourceGroupState *sgState = FindSourceGroupState(i, iter->first.second, sgp);
-              if (!sgState)
-                continue;
               if (lost_assert(source, group, i, iter->first.second))
                 set.insert(iter->first);
+              continue;
+            }
+          // shared entry: the Assert is lost on every downstream link of the interface
+          NeighborhoodStatus *nstatus = FindNeighborhoodStatus(i);
+          if (!nstatus)
+            continue;
+          for (NeighborList::iterator nb = nstatus->neighbors.begin(); nb != nstatus->neighbors.end(); nb++)
+            {
+              if (lost_assert(source, group, i, nb->neighborIfaceAddr))
+                set.insert(WiredEquivalentInterface(i, nb->neighborIfaceAddr));
             }
         }
       return set;
@@ -5280,6 +6165,37 @@ MulticastRoutingProtocol::GetTypeId (void)
       return resC;
     }
 
+    Time
+    MulticastRoutingProtocol::DensityJitter (uint32_t interface, double l, double u, Time slot)
+    {
+      if (m_densityJitter)
+        {
+          // one slot per neighbor sharing the link: dense neighborhoods spread their messages
+          // over more time instead of colliding, sparse ones send sooner
+          NeighborhoodStatus *nstatus = FindNeighborhoodStatus(interface);
+          double window = (nstatus ? nstatus->neighbors.size() : 0) * slot.GetMicroSeconds();
+          u = std::min(l + window, (double) m_jitterMax.GetMicroSeconds());
+          l = std::min(std::min(l, window), u);
+        }
+      return TransmissionDelay(l, u, Time::US);
+    }
+
+    Time
+    MulticastRoutingProtocol::ForwardingJitter (uint32_t interface)
+    {
+      return DensityJitter(interface, 10, 250, m_jitterSlot);
+    }
+
+    Time
+    MulticastRoutingProtocol::ControlJitter (uint32_t interface)
+    {
+      Time delay = DensityJitter(interface, 1000, 3000, m_controlJitterSlot);
+      InterfaceState *ifs = FindInterfaceState(interface);
+      if (m_controlPriority && ifs)
+        ifs->controlBusy = Max(ifs->controlBusy, Simulator::Now() + delay);
+      return delay;
+    }
+
     Time
     MulticastRoutingProtocol::TransmissionDelay ()
     {
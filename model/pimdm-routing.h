@@ -39,6 +39,7 @@
 #include <ns3/event-garbage-collector.h>
 #include <ns3/timer.h>
 #include <ns3/traced-callback.h>
+#include <ns3/data-rate.h>
 #include <ns3/ipv4.h>
 #include <ns3/ipv4-routing-protocol.h>
 #include <ns3/ipv4-static-routing.h>
@@ -102,6 +103,128 @@ namespace ns3
         }
     };
 
+    /// Relay metadata of a received data packet, read once from its RelayTag.
+    struct RelayInfo
+    {
+        bool relayed;         ///< the packet carried a RelayTag
+        Ipv4Address sender;   ///< neighbor that relayed the packet
+        Ipv4Address receiver; ///< receiver named by the relaying neighbor
+        RelayInfo () :
+            relayed(false)
+        {
+        }
+        RelayInfo (Ipv4Address s, Ipv4Address r) :
+            relayed(true), sender(s), receiver(r)
+        {
+        }
+    };
+
+    /// Data packet held while the route towards its source is looked up.
+    struct PendingDataPacket
+    {
+        Ptr<Packet> packet;   ///< packet as received, IPv4 header included, relay tag removed
+        Ipv4Address sender;   ///< sender address
+        uint16_t port;        ///< sender port
+        uint32_t interface;   ///< receiving interface
+        RelayInfo relay;      ///< relay metadata of the packet
+        PendingDataPacket (Ptr<Packet> p, Ipv4Address s, uint16_t o, uint32_t i, const RelayInfo &r) :
+            packet(p), sender(s), port(o), interface(i), relay(r)
+        {
+        }
+    };
+
+    /// Route lookup in progress towards a destination, used with on-demand unicast routing protocols.
+    struct PendingRoute
+    {
+        uint32_t retries;                     ///< probes sent so far
+        Time backoff;                         ///< delay before the next probe
+        EventId probe;                        ///< next probe event
+        std::list<PendingDataPacket> packets; ///< data packets waiting for the route
+        PendingRoute () :
+            retries(0), backoff(Seconds(RouteProbe_Backoff))
+        {
+        }
+        PendingRoute (Time b) :
+            retries(0), backoff(b)
+        {
+        }
+    };
+
+    /// Serialized Hello of an interface, with the option values it carries.
+    struct HelloCache
+    {
+        Ptr<Packet> packet;           ///< Hello with its PIM header, null until first sent
+        uint16_t holdTime;            ///< Hold Time option
+        uint32_t generationID;        ///< Generation ID option
+        Time propagationDelay;        ///< LAN Prune Delay option
+        Time overrideInterval;        ///< LAN Prune Delay option
+        bool stateRefreshCapable;     ///< State Refresh Capable option present
+        Time stateRefreshInterval;    ///< State Refresh Capable option
+        HelloCache () :
+            holdTime(0), generationID(0), stateRefreshCapable(false)
+        {
+        }
+    };
+
+    /// Serialized State Refresh originated for one (S,G) on one interface: only TTL and flags are patched per message.
+    struct StateRefreshTemplate
+    {
+        std::vector<uint8_t> bytes;   ///< message with its PIM header
+        Ipv4Address originator;       ///< originator address in bytes
+        uint32_t metricPreference;    ///< metric preference in bytes
+        uint32_t metric;              ///< metric in bytes
+        uint8_t interval;             ///< interval in bytes
+        StateRefreshTemplate () :
+            metricPreference(0), metric(0), interval(0)
+        {
+        }
+    };
+
+    /// Data relay held on an interface behind control messages.
+    struct HeldRelay
+    {
+        Ptr<Packet> packet;    ///< data packet, without its IP header
+        Ipv4Header header;     ///< IP header of the data packet
+        Ipv4Address receiver;  ///< relay receiver
+    };
+
+    /// Per-interface state, indexed by the interface number.
+    struct InterfaceState
+    {
+        Ptr<Socket> socket;            ///< PIM socket bound to the interface, null if not PIM-enabled
+        Ptr<Socket> dataSocket;        ///< multicast data socket, shared by all the registered groups
+        Ipv4InterfaceAddress address;  ///< local address, mask and broadcast
+        Ipv4Address subnetBroadcast;   ///< subnet-directed broadcast, destination of PIM control messages
+        bool pimEnabled;               ///< PIM enabled on the interface
+        bool excluded;                 ///< interface excluded from multicast
+        NeighborhoodStatus *neighborhood; ///< neighborhood status, null if none
+        Time controlBusy;              ///< control messages scheduled until then, data relays wait behind them
+        std::list<Ptr<Packet> > controlQueue; ///< control messages waiting, PIM header included
+        EventId controlDrain;          ///< next transmission from the control queue
+        std::list<HeldRelay> heldRelays; ///< data relays waiting for controlBusy, in arrival order
+        EventId relayRelease;          ///< release of heldRelays once controlBusy has passed
+        HelloCache hello;              ///< last Hello sent on the interface
+        InterfaceState () :
+            subnetBroadcast(Ipv4Address::GetBroadcast()), pimEnabled(false), excluded(false), neighborhood(0)
+        {
+        }
+    };
+
+    /// Identity of a data packet: (S,G) and IP identification.
+    typedef std::pair<SourceGroupPair, uint16_t> DataPacketId;
+
+    /// Token bucket policing the data of one (S,G) received on one interface.
+    struct TokenBucket
+    {
+        double tokens;     ///< bytes that can be accepted now
+        Time last;         ///< last refill
+        uint32_t dropped;  ///< packets dropped
+        TokenBucket () :
+            tokens(0), dropped(0)
+        {
+        }
+    };
+
 /// This class encapsulates all data structures needed for maintaining internal state of an PIM_DM node.
     class MulticastRoutingProtocol : public Ipv4RoutingProtocol
     {
@@ -120,8 +243,8 @@ namespace ns3
 
         std::map<SourceGroupPair, std::set<uint32_t> > m_LocalReceiver;
 
-        ///pim ENABLED INTERFACES
-        std::map<uint32_t, bool> m_IfacePimEnabled; //TODO, right now all interfaces are pim enabled.
+        std::vector<InterfaceState> m_interfaces; ///< Per-interface state, indexed by the interface number.
+        std::set<Ipv4Address> m_dataGroups; ///< Groups accepted by the multicast data sockets.
         Time m_helloTime; ///< Hello Time
         uint16_t m_helloHoldTime; ///< Default hello hold time
         uint32_t m_generationID; ///< Generation ID for hello messages
@@ -142,6 +265,7 @@ namespace ns3
          * uses the MRIB to make decisions regarding RPF interfaces.
          */
         std::map<Ipv4Address, RoutingMulticastTable> m_mrib; ///< Multicast Routing Information Base (MRIB)
+        std::map<std::pair<Ipv4Address, uint32_t>, Ptr<Ipv4Route> > m_outputRoutes; ///< Routes of locally originated multicast, per (group, interface).
 
         /// IP protocol
         Ptr<Ipv4> m_ipv4;
@@ -157,17 +281,68 @@ namespace ns3
         Time m_rpfCheck;
         Timer m_rpfChecker;
 
+        Timer m_helloTimer; ///< Hello Timer (HT), a single timer for all the interfaces (RFC 3973, section 4.1.1).
+        bool m_helloSuppression; ///< Skip periodic Hellos on interfaces recently refreshed by other control messages.
+        bool m_started; ///< DoStart has run: interfaces added later are announced with a triggered Hello.
+
         Time m_LanDelay;
 
         EventId eventUpstream;
 
         Time m_startDelay;
 
+        bool m_pruneAck; ///< Acknowledged prune mode.
+        Time m_pruneRetryPeriod; ///< Prune retransmission timeout in acknowledged prune mode.
+        bool m_densityAwareOverride; ///< Scale the override window (t_override) with the number of neighbors.
+        bool m_graftRetryAdaptive; ///< Derive the Graft Retry Timer from the Graft/GraftAck round trip time.
+        bool m_sharedMediumTib; ///< Keep one TIB entry per (S,G,I) on multi-access interfaces, not one per neighbor.
+        bool m_nativeForwarding; ///< Forward data in RouteInput through the multicast forward callback.
+        uint32_t m_unicastRelayThreshold; ///< Largest fan-out relayed by unicast copies instead of one broadcast.
+
+        ///\name Duplicate suppression of relayed data
+        //\{
+        std::map<DataPacketId, Time> m_duplicates; ///< Data packets already processed, with their arrival time.
+        std::list<DataPacketId> m_duplicateOrder;  ///< Same packets, oldest first.
+        uint32_t m_duplicateCacheSize; ///< Packets remembered, 0 disables the cache.
+        Time m_duplicateLifetime;      ///< Time a packet is remembered.
+        //\}
+        bool m_densityJitter; ///< Scale relay and control jitter with the number of neighbors on the link.
+        Time m_jitterSlot;    ///< Jitter window of relayed data per neighbor.
+        Time m_controlJitterSlot; ///< Jitter window of control messages per neighbor.
+        Time m_jitterMax;     ///< Largest jitter window.
+        bool m_controlPriority; ///< Hold data relays on an interface while control messages are scheduled on it.
+        uint8_t m_controlTos;   ///< Type of service of control messages.
+        bool m_controlQueue;    ///< Send control messages through the per-interface queue.
+        Time m_controlPacing;   ///< Minimum time between two queued control messages on an interface.
+
+        ///\name Ingress policer of data per (S,G) and interface
+        //\{
+        std::map<std::pair<SourceGroupPair, uint32_t>, TokenBucket> m_policers; ///< Buckets per ((S,G), input interface).
+        DataRate m_policerRate; ///< Data accepted per (S,G) and interface, 0 disables the policer.
+        uint32_t m_policerBurst; ///< Bucket depth in bytes.
+        uint32_t m_policerDrops; ///< Data packets dropped by the policer.
+        Time m_policerSweep;     ///< Last removal of the idle buckets.
+        //\}
+        std::pair<DataPacketId, uint32_t> m_admission; ///< Last data packet admitted or dropped by RecvPIMData, with its input interface.
+        bool m_admitted; ///< Verdict on that packet, reused by RouteInput in native forwarding mode.
+        std::vector<uint8_t> m_rxControlBytes; ///< Received Join/Prune or Graft, decoded in place.
+        std::map<std::pair<SourceGroupPair, uint32_t>, StateRefreshTemplate> m_refreshTemplates; ///< State Refresh originated per ((S,G), interface).
+        std::map<SourceGroupPair, Ptr<Ipv4MulticastRoute> > m_nativeRoutes; ///< Resolved olists, one route per (S,G).
+
+        ///\name Route lookup towards unresolved destinations
+        //\{
+        std::map<Ipv4Address, PendingRoute> m_pendingRoutes; ///< Pending route lookups, one per destination.
+        Time m_routeProbeBackoff;     ///< Initial back-off between two probes.
+        uint32_t m_routeProbeRetries; ///< Probes sent before giving up.
+        uint32_t m_routeProbeQueueLen; ///< Data packets held per destination.
+        //\}
+
         TracedCallback<Ptr<const Packet> > m_rxControlPacketTrace;
         TracedCallback<Ptr<const Packet> > m_txControlPacketTrace;
 
         TracedCallback<Ptr<const Packet> > m_rxDataPacketTrace;
         TracedCallback<Ptr<const Packet> > m_txDataPacketTrace;
+        TracedCallback<Ptr<const Packet> > m_policerDropTrace;
 
         TracedCallback<Ptr<const Packet> > m_txControlRouteTrace;
         TracedCallback<uint32_t> m_routingTableChanged;
@@ -242,12 +417,24 @@ namespace ns3
 
         Ipv4Address
         GetLocalAddress (uint32_t interface);
+        /// \brief Interface state of an interface, NULL if the interface is unknown.
+        InterfaceState*
+        FindInterfaceState (uint32_t interface);
+        /// \brief Interface state of an interface, created on first use.
+        InterfaceState&
+        InsertInterfaceState (uint32_t interface);
+        /// \brief True if the interface is excluded from multicast: no PIM control, no sockets, no data.
+        bool
+        IsExcluded (uint32_t interface);
         bool
         isValidGateway (Ipv4Address gw);
 
         // From Ipv4RoutingProtocol
         virtual Ptr<Ipv4Route>
         RouteOutput (Ptr<Packet> p, const Ipv4Header &header, Ptr<NetDevice> oif, Socket::SocketErrno &sockerr);
+        /// \brief Route of locally originated multicast towards group on interface, built once and cached.
+        Ptr<Ipv4Route>
+        GetOutputRoute (Ipv4Address group, uint32_t interface);
         // From Ipv4RoutingProtocol
         virtual bool
         RouteInput (Ptr<const Packet> p, const Ipv4Header &header, Ptr<const NetDevice> idev,
@@ -296,9 +483,28 @@ namespace ns3
         bool
         GetStopTx ();
 
+        /// \brief Install the olist of (S,G) as the route used by RouteInput in native forwarding mode.
         void
         AddMulticastRoute (Ipv4Address source, Ipv4Address group, uint32_t inputInterface,
                            std::vector<uint32_t> outputInterfaces);
+        void
+        RemoveMulticastRoute (Ipv4Address source, Ipv4Address group);
+        /// \brief True if the data packet is neither a duplicate nor above the policed rate.
+        bool
+        AdmitData (const SourceGroupPair &sgp, uint16_t identification, uint32_t interface, Ptr<const Packet> packet,
+                   uint32_t size);
+        /// \brief True if the data packet of (S,G) received on interface is within the configured rate.
+        bool
+        PolicerConform (const SourceGroupPair &sgp, uint32_t interface, uint32_t size);
+        /// \brief Data packets dropped by the ingress policer.
+        uint32_t
+        GetPolicerDrops () const;
+        /// \brief Data packets of (S,G) dropped by the ingress policer on interface, since the flow was last idle.
+        uint32_t
+        GetPolicerDrops (Ipv4Address source, Ipv4Address group, uint32_t interface) const;
+        /// \brief True if the data packet has already been processed, otherwise remember it.
+        bool
+        IsDuplicate (const DataPacketId &id);
 
         void
         AddMulticastGroup (Ipv4Address group);
@@ -359,6 +565,13 @@ namespace ns3
         double
         OverrideInterval (uint32_t interface);
 
+        /// \brief Window t_override is drawn from. With density-aware override it grows with the routers that may
+        /// override the same Prune, so that the first Join is heard before the others fire (SRM-style), bounded by OI (I).
+        /// \param interface Interface.
+        /// \return Override window in seconds.
+        double
+        OverrideWindow (uint32_t interface);
+
         PIMHeader::EncodedUnicast
         ForgeEncodedUnicast (Ipv4Address unicast);
         PIMHeader::EncodedGroup
@@ -401,6 +614,13 @@ namespace ns3
         SendHello (uint32_t interface);
         void
         SendHelloReply (uint32_t interface, Ipv4Address destination);
+        /// \brief Schedule a triggered Hello towards a new neighbor, merged with any other one pending on the interface.
+        /// \param interface Interface of the neighbor.
+        /// \param neighbor New neighbor address.
+        void
+        TriggerHello (uint32_t interface, Ipv4Address neighbor);
+        void
+        SendTriggeredHello (uint32_t interface);
         void
         RecvHello (pimdm::PIMHeader::HelloMessage &hello, Ipv4Address sender, Ipv4Address receiver, uint32_t interface);
 
@@ -415,7 +635,7 @@ namespace ns3
         ForwardingStateRefresh (PIMHeader::StateRefreshMessage &refresh, Ipv4Address sender, Ipv4Address receiver);
 
         void
-        RecvJP (PIMHeader::JoinPruneMessage &jp, Ipv4Address sender, Ipv4Address receiver, uint32_t interface);
+        RecvJP (JoinPruneGraftView &view, Ipv4Address sender, Ipv4Address receiver, uint32_t interface);
 
         void
         RecvJoin (PIMHeader::JoinPruneMessage &jp, Ipv4Address &sender, Ipv4Address &receiver, uint32_t &interface,
@@ -454,7 +674,7 @@ namespace ns3
         SendGraftUnicast (Ipv4Address destination, SourceGroupPair pair);
 
         void
-        RecvGraft (PIMHeader::GraftMessage &graft, Ipv4Address sender, Ipv4Address receiver, uint32_t interface);
+        RecvGraft (JoinPruneGraftView &view, Ipv4Address sender, Ipv4Address receiver, uint32_t interface);
         void
         RecvGraftDownstream (PIMHeader::GraftMessage &graft, Ipv4Address sender, Ipv4Address receiver,
                              const PIMHeader::EncodedSource &source, PIMHeader::EncodedGroup &group,
@@ -469,6 +689,12 @@ namespace ns3
         void
         RecvGraftAck (PIMHeader::GraftAckMessage &graftAck, Ipv4Address sender, Ipv4Address receiver,
                       uint32_t interface);
+        /// \brief Acknowledge a Prune: a Graft Ack listing the source among the pruned ones (acknowledged prune mode).
+        /// \param interface Interface the Prune was received on.
+        /// \param receiver Sender of the Prune.
+        /// \param pair Pruned source-group pair.
+        void
+        SendPruneAckBroadcast (uint32_t interface, const Ipv4Address receiver, SourceGroupPair &pair);
 
         void
         SendPruneBroadcast (uint32_t interface, SourceGroupPair &sgpair, Ipv4Address target);
@@ -487,7 +713,7 @@ namespace ns3
                    uint32_t interface);
         void
         RecvPIMData (Ptr<Packet> receivedPacket, Ipv4Address senderIfaceAddr, uint16_t senderIfacePort,
-                     uint32_t interface);
+                     uint32_t interface, const RelayInfo &relay);
 
         void
         UpdateAssertTimer (SourceGroupPair &sgp, uint32_t interface, const Ipv4Address destination);
@@ -505,6 +731,17 @@ namespace ns3
         UpdateGraftTimer (SourceGroupPair &sgp, uint32_t interface, Time delay, const Ipv4Address destination);
         void
         UpdateGraftTimer (SourceGroupPair &sgp, uint32_t interface, const Ipv4Address destination);
+        /// \brief Graft retry period towards the upstream neighbor, from its measured round trip time and the retries done.
+        /// \param interface Interface towards the neighbor.
+        /// \param destination Upstream neighbor.
+        /// \return Graft_Retry_Period if no round trip sample is available, the backed-off retransmission timeout otherwise.
+        Time
+        GraftRetryPeriod (uint32_t interface, const Ipv4Address destination);
+        /// \brief Update the neighbor round trip time estimate (RFC 6298) with a Graft/GraftAck sample.
+        void
+        UpdateGraftRtt (NeighborState *ns, Time sample);
+        void
+        UpdatePruneRetryTimer (SourceGroupPair &sgp, uint32_t interface, const Ipv4Address destination);
         void
         UpdateOverrideTimer (SourceGroupPair &sgp, uint32_t interface, Time delay, const Ipv4Address destination);
         void
@@ -521,12 +758,69 @@ namespace ns3
         UpdateStateRefreshTimer (SourceGroupPair &sgp, uint32_t interface, Time delay, const Ipv4Address destination);
         void
         UpdateStateRefreshTimer (SourceGroupPair &sgp, uint32_t interface, const Ipv4Address destination);
+        ///\name Timer updates on a state handle: the timers are bound once by BindSourceGroupTimers.
+        //\{
+        void
+        UpdateAssertTimer (SourceGroupState *sgState, Time delay);
+        void
+        UpdatePruneTimer (SourceGroupState *sgState, Time delay);
+        void
+        UpdatePruneDownstreamTimer (SourceGroupState *sgState);
+        void
+        UpdatePrunePendingTimer (SourceGroupState *sgState, Time delay);
+        void
+        UpdateGraftTimer (SourceGroupState *sgState, Time delay);
+        void
+        UpdatePruneRetryTimer (SourceGroupState *sgState);
+        void
+        UpdateOverrideTimer (SourceGroupState *sgState, Time delay);
+        void
+        UpdatePruneLimitTimer (SourceGroupState *sgState, Time delay);
+        void
+        UpdateSourceActiveTimer (SourceGroupState *sgState, Time delay);
+        void
+        UpdateStateRefreshTimer (SourceGroupState *sgState, Time delay);
+        //\}
         void
         SendPacketPIMUnicast (Ptr<Packet> packet, const PIMHeader &message, Ipv4Address destination);
         void
         SendPacketHBroadcastInterface (Ptr<Packet> packet, Ipv4Header &ipv4Header, uint32_t interface);
+        /// \brief Relay a data packet on an interface to a single downstream neighbor, with MAC acknowledgements.
+        void
+        SendPacketHUnicastInterface (Ptr<Packet> packet, Ipv4Header &ipv4Header, uint32_t interface,
+                                     Ipv4Address receiver);
+        void
+        SendPacketHRelayInterface (Ptr<Packet> packet, Ipv4Header &ipv4Header, uint32_t interface,
+                                   Ipv4Address receiver);
         void
         SendPacketPIMRoutersInterface (Ptr<Packet> packet, const PIMHeader &message, uint32_t interface);
+        /// \brief Send a packet already holding its PIM header to all PIM routers on interface.
+        void
+        SendControlInterface (Ptr<Packet> packet, uint32_t interface);
+        /// \brief Send message to all PIM routers on interface after delay, through the control queue if enabled.
+        void
+        QueueControl (uint32_t interface, const PIMHeader &message, Time delay);
+        /// \brief Send packet, already holding its PIM header, to all PIM routers on interface after delay.
+        void
+        QueueControlPacket (uint32_t interface, Ptr<Packet> packet, Time delay);
+        /// \brief Hello of interface, serialized again only when its options change.
+        Ptr<Packet>
+        HelloPacket (uint32_t interface);
+        /// \brief State Refresh msg of (S,G) on interface, patched from the previous one when possible.
+        Ptr<Packet>
+        StateRefreshPacket (uint32_t interface, const SourceGroupPair &sgp, PIMHeader &msg);
+        /// \brief Forget the State Refresh templates of (S,G) on every interface, once it is no longer originated.
+        void
+        RemoveStateRefreshTemplates (const SourceGroupPair &sgp);
+        /// \brief Forget the State Refresh templates of interface.
+        void
+        RemoveStateRefreshTemplates (uint32_t interface);
+        /// \brief Send the next queued control messages of interface.
+        void
+        ControlQueueDrain (uint32_t interface);
+        /// \brief Send the data relays held on interface, in order, once its control messages have left.
+        void
+        ReleaseHeldRelays (uint32_t interface);
         void
         SendPacketUnicast (Ptr<Packet> packet, Ipv4Address destination);
         //end
@@ -568,12 +862,14 @@ namespace ns3
         SendRenew (SourceGroupPair sgp, uint32_t interface);
 
         void
-        HelloTimerExpire (uint32_t interface);
+        HelloTimerExpire ();
         void
         OTTimerExpire (SourceGroupPair &sgp, uint32_t interface, Ipv4Address destination);
         void
         GRTTimerExpire (SourceGroupPair &sgp, uint32_t interface, Ipv4Address destination);
         void
+        PRTTimerExpire (SourceGroupPair &sgp, uint32_t interface, Ipv4Address destination);
+        void
         PLTTimerExpire (SourceGroupPair &sgp, uint32_t interface, Ipv4Address destination);
         void
         PLTTimerExpireDownstream (SourceGroupPair &sgp, uint32_t interface, Ipv4Address neighbor); //AX
@@ -593,6 +889,9 @@ namespace ns3
         void
         UpstreamStateMachine (SourceGroupPair &sgp);
 
+        /// \brief TIB key of the (S,G) state towards a neighbor: (I,N), or (I,ANY) with shared-medium storage.
+        WiredEquivalentInterface
+        TibKey (uint32_t interface, Ipv4Address neighbor);
         void
         InsertSourceGroupList (uint32_t interface, Ipv4Address neighbor);
         SourceGroupList*
@@ -601,6 +900,9 @@ namespace ns3
         EraseSourceGroupList (uint32_t interface, Ipv4Address neighbor);
         void
         InsertSourceGroupState (uint32_t interface, Ipv4Address neighbor, SourceGroupPair sgp);
+        /// \brief Bind the timers of a TIB entry to their expiry handlers, once when the entry is created.
+        void
+        BindSourceGroupTimers (SourceGroupState *sgState, uint32_t interface, Ipv4Address neighbor);
         SourceGroupState*
         FindSourceGroupState (uint32_t interface, Ipv4Address neighbor, const SourceGroupPair &sgp);
         SourceGroupState*
@@ -696,11 +998,28 @@ namespace ns3
         RPF_interface (Ipv4Address source, Ipv4Address group);
 
         /// \brief Find the route for on-demand routing protocols.
+        /// Requests towards a destination already being looked up are merged.
         /// \param destination Node to lookup.
         void
         AskRoute (Ipv4Address destination);
+        /// \brief Send a probe towards the destination, retrying with exponential back-off until the route is known.
+        /// \param destination Node to lookup.
         void
         AskRoutez (Ipv4Address destination);
+        /// \brief Hold a data packet until the route towards its source is known.
+        /// \param source Source of the packet, i.e., destination of the route lookup.
+        /// \param packet Packet as received.
+        /// \param sender Sender address.
+        /// \param port Sender port.
+        /// \param interface Receiving interface.
+        /// \param relay Relay metadata of the packet.
+        void
+        EnqueuePendingData (Ipv4Address source, Ptr<Packet> packet, Ipv4Address sender, uint16_t port,
+                            uint32_t interface, const RelayInfo &relay);
+        /// \brief The route towards destination is known: stop probing and replay the held data packets.
+        /// \param destination Destination of the route lookup.
+        void
+        RouteResolved (Ipv4Address destination);
 
         /// \brief There are receivers for the given SourceGroup pair.
         /// \param sgp source-group pair.
@@ -832,6 +1151,16 @@ namespace ns3
         TransmissionDelay (double l, double u);
         Time
         TransmissionDelay ();
+        /// Random delay in [l,u] microseconds. With DensityAwareJitter the window is one slot per neighbor
+        /// on the interface, starting at l (or earlier on sparse links) and ending at most at JitterMax.
+        Time
+        DensityJitter (uint32_t interface, double l, double u, Time slot);
+        /// Jitter applied to data relayed on the interface.
+        Time
+        ForwardingJitter (uint32_t interface);
+        /// Jitter applied to control messages sent on the interface.
+        Time
+        ControlJitter (uint32_t interface);
     };
 
     struct RelayTag : public Tag
@@ -39,6 +39,7 @@
 #include <ns3/pimdm-packet.h>
 #include <ns3/nstime.h>
 #include <ns3/timer.h>
+#include <ns3/event-id.h>
 
 namespace ns3
 {
@@ -64,6 +65,8 @@ namespace ns3
     const uint32_t Assert_Time = 180;
 /// Timer Name: Graft Retry Timer (GRT (S,G)). In the absence of receipt of a GraftAck message, the time before retransmission of a Graft message.
     const uint32_t Graft_Retry_Period = 3;
+/// Lower bound of the Graft Retry Timer when it is derived from the measured Graft/GraftAck round trip time.
+    const double Graft_Retry_Min = 0.1;
 /// Used to prevent Prune storms on a LAN.
     const uint32_t t_limit = 10; //210 in LAN
     const uint32_t t_shorter = 2;
@@ -115,6 +118,18 @@ namespace ns3
      * because of the broadcast nature of the wireless channel.
      */
     const uint32_t PRUNE_DOWN = 4;
+/// Acknowledged prune: time before retransmitting an unacknowledged Prune.
+    const double Prune_Retry_Period = 0.3;
+/// Acknowledged prune: retransmissions of an unacknowledged Prune.
+    const uint32_t MaxPruneRetry = 3;
+/// Route probe: initial back-off between two probes sent towards the same unresolved destination, doubled at each retry.
+    const double RouteProbe_Backoff = 0.5;
+/// Route probe: number of probes sent towards an unresolved destination before giving up.
+    const uint32_t RouteProbe_MaxRetry = 5;
+/// Route probe: data packets held for an unresolved source, replayed once the RPF route is known.
+    const uint32_t RouteProbe_QueueLen = 64;
+/// Duplicate cache: time a relayed data packet is remembered.
+    const double Duplicate_Lifetime = 1;
 
     struct AssertMetric
     {
@@ -211,12 +226,13 @@ namespace ns3
         UpstreamState () :
             GraftPrune(GP_Forwarding), SG_GRT(Timer::CANCEL_ON_DESTROY), SG_OT(Timer::CANCEL_ON_DESTROY),
             SG_PLT(Timer::CANCEL_ON_DESTROY), SG_SAT(Timer::CANCEL_ON_DESTROY), SG_SRT(Timer::CANCEL_ON_DESTROY),
-            origination(NotOriginator), valid(false)
+            SG_PRT(Timer::CANCEL_ON_DESTROY), pruneRetry(0), origination(NotOriginator), valid(false)
         {
         }
         UpstreamState (bool valid) :
-            GraftPrune(GP_Forwarding), SG_GRT(Timer::CANCEL_ON_DESTROY), SG_OT(Timer::CANCEL_ON_DESTROY),
-            SG_PLT(Timer::CANCEL_ON_DESTROY), SG_SAT(Timer::CANCEL_ON_DESTROY), SG_SRT(Timer::CANCEL_ON_DESTROY),
+            GraftPrune(GP_Forwarding), SG_GRT(Timer::CANCEL_ON_DESTROY), graftSent(Seconds(0)),
+            SG_OT(Timer::CANCEL_ON_DESTROY), SG_PLT(Timer::CANCEL_ON_DESTROY), SG_SAT(Timer::CANCEL_ON_DESTROY),
+            sourceActive(Seconds(0)), SG_SRT(Timer::CANCEL_ON_DESTROY), SG_PRT(Timer::CANCEL_ON_DESTROY), pruneRetry(0),
             origination(NotOriginator), valid(valid)
         {
         }
@@ -233,6 +249,8 @@ namespace ns3
          * The timer is stopped when a Graft Ack message is received.  This timer is normally set to Graft_Retry_Period (see 4.8).
          */
         Timer SG_GRT;
+        /// Time the pending Graft left the node, zero when it was retransmitted (no valid RTT sample).
+        Time graftSent;
         /**
          * Upstream Override Timer (OT). This timer is set when a Prune(S,G) is received on the upstream
          * interface where olist(S,G) != NULL.  When the timer expires, a Join(S,G) message
@@ -255,6 +273,8 @@ namespace ns3
          * This timer is normally set to SourceLifetime (see 4.8).
          */
         Timer SG_SAT;
+        /// Last data packet from S: SAT(S,G) expires its delay after it, re-arming itself for what is left.
+        Time sourceActive;
         /**
          * Originator State: State Refresh Timer (SRT).
          * This timer controls when State Refresh messages are generated.
@@ -263,6 +283,14 @@ namespace ns3
          * This timer is normally set to StateRefreshInterval (see 4.8).
          */
         Timer SG_SRT;
+        /**
+         * Prune Retry Timer (PRT), used only with acknowledged prunes.
+         * Set when a Prune is sent upstream, stopped by the matching Prune Ack.
+         * When it expires the Prune is sent again, up to MaxPruneRetry times.
+         */
+        Timer SG_PRT;
+        /// Prune retransmissions done.
+        uint8_t pruneRetry;
         /// Pointer to Origination(S,G) machine
         enum Origination origination; ///<4.1.2.
         /// bool
@@ -326,6 +354,8 @@ namespace ns3
         uint8_t SG_SR_TTL;
         /// TTL of the packet to use in Data packets.
         uint8_t SG_DATA_TTL;
+        /// Shared-medium storage: downstream neighbors whose Prune(S,G) holds the interface in Pruned state.
+        std::set<Ipv4Address> prunedNeighbors;
     };
 
     static inline bool
@@ -346,7 +376,7 @@ namespace ns3
             neighborRefresh(Seconds(0)), neighborTimeout(Seconds(0)), neighborTimeoutB(false),
             neigborNLT(Timer::CANCEL_ON_DESTROY), neighborHoldTime(Seconds(0)), neighborT(0),
             neighborPropagationDelay(Seconds(0)), neighborOverrideInterval(Seconds(0)), neighborGenerationID(0),
-            neighborVersion(0), neighborReserved(0)
+            neighborVersion(0), neighborReserved(0), neighborGraftSRTT(Seconds(0)), neighborGraftRTTVAR(Seconds(0))
         {
           neighborGraftRetry[0] = 0;
           neighborGraftRetry[1] = (uint8_t) MaxGraftRetry;
@@ -389,6 +419,10 @@ namespace ns3
         uint16_t neighborReserved;
         /// Graft retries.
         uint8_t neighborGraftRetry[2];
+        /// Smoothed Graft/GraftAck round trip time, zero until the first sample.
+        Time neighborGraftSRTT;
+        /// Graft/GraftAck round trip time variation.
+        Time neighborGraftRTTVAR;
     };
 
     static inline bool
@@ -418,15 +452,17 @@ namespace ns3
     struct NeighborhoodStatus
     {
         NeighborhoodStatus () :
-            stateRefreshCapable(false), LANDelayEnabled(false), hello_timer(Timer::CANCEL_ON_DESTROY),
-            propagationDelay(Seconds(Propagation_Delay)), overrideInterval(Seconds(Override_Interval)),
+            stateRefreshCapable(false), LANDelayEnabled(false), triggeredHelloTarget(ALL_PIM_ROUTERS4),
+            lastControlTx(Seconds(0)), propagationDelay(Seconds(Propagation_Delay)), overrideInterval(Seconds(Override_Interval)),
             stateRefreshInterval(Seconds(RefreshInterval)), pruneHoldtime(Seconds(PruneHoldTime))
         {
           neighbors.clear();
         }
         bool stateRefreshCapable; ///< State refresh capability.
         bool LANDelayEnabled; ///< LAN Delay Enabled.
-        Timer hello_timer; ///< Hello Timer (HT) (RFC 3973, section 4.1.1).
+        EventId triggeredHello; ///< Triggered Hello, shared by the new neighbors heard before it is sent.
+        Ipv4Address triggeredHelloTarget; ///< Triggered Hello destination, ALL-PIM-ROUTERS once merged.
+        Time lastControlTx; ///< Last control message sent on the interface.
         Time propagationDelay; ///< Propagation delay.
         Time overrideInterval; ///< Override Interval field is a time interval in units of milliseconds.
         Time stateRefreshInterval; ///< Router's configured state refresh
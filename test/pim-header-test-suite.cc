@@ -26,6 +26,7 @@
 #include <ns3/test.h>
 #include <ns3/pimdm-packet.h>
 #include <ns3/packet.h>
+#include <ns3/buffer.h>
 
 namespace ns3
 {
@@ -475,6 +476,311 @@ namespace ns3
       }
   }
 
+  static std::vector<uint8_t>
+  SerializePim (const pimdm::PIMHeader &msg)
+  {
+    Packet packet;
+    packet.AddHeader(msg);
+    std::vector<uint8_t> bytes(packet.GetSize());
+    packet.CopyData(&bytes[0], bytes.size());
+    return bytes;
+  }
+
+  /// Checksum of the bytes from start on, as Buffer::Iterator::CalculateIpChecksum computes it.
+  static uint16_t
+  IpChecksum (const std::vector<uint8_t> &bytes, uint32_t start)
+  {
+    Buffer buffer;
+    buffer.AddAtStart(bytes.size());
+    Buffer::Iterator i = buffer.Begin();
+    i.Write(&bytes[0], bytes.size());
+    i = buffer.Begin();
+    i.Next(start);
+    return i.CalculateIpChecksum(bytes.size() - start, 0);
+  }
+
+  static pimdm::PIMHeader
+  JoinPruneSample (uint8_t numGroups)
+  {
+    pimdm::PIMHeader msg;
+    msg.SetVersion(2);
+    msg.SetType(pimdm::PIM_JP);
+    pimdm::PIMHeader::JoinPruneMessage &jp = msg.GetJoinPruneMessage();
+    pimdm::PIMHeader::EncodedUnicast eu =
+      { 1, 0, Ipv4Address("10.0.0.1") };
+    jp.m_joinPruneMessage.m_upstreamNeighborAddr = eu;
+    jp.m_joinPruneMessage.m_reserved = 0;
+    jp.m_joinPruneMessage.m_numGroups = numGroups;
+    jp.m_joinPruneMessage.m_holdTime = Seconds(210);
+    uint32_t joins[] =
+      { 2, 0, 1 };
+    uint32_t prunes[] =
+      { 1, 2, 0 };
+    for (uint32_t g = 0; g < 3; g++)
+      {
+        pimdm::PIMHeader::MulticastGroupEntry entry;
+        pimdm::PIMHeader::EncodedGroup eg =
+          { 1, 0, (uint8_t) (g % 2), 0, 0, (uint8_t) (24 + g), Ipv4Address(0xe1000001 + g) };
+        entry.m_multicastGroupAddr = eg;
+        entry.m_numberJoinedSources = joins[g];
+        entry.m_numberPrunedSources = prunes[g];
+        for (uint32_t j = 0; j < joins[g] + prunes[g]; j++)
+          {
+            pimdm::PIMHeader::EncodedSource es =
+              { 1, 0, 0, (uint8_t) (j % 2), 1, (uint8_t) (g % 2), 32, Ipv4Address(0x0a010000 + g * 256 + j) };
+            if (j < joins[g])
+              entry.m_joinedSourceAddrs.push_back(es);
+            else
+              entry.m_prunedSourceAddrs.push_back(es);
+          }
+        jp.m_multicastGroups.push_back(entry);
+      }
+    return msg;
+  }
+
+  static pimdm::PIMHeader
+  StateRefreshSample (uint8_t ttl, uint8_t P, uint8_t N)
+  {
+    pimdm::PIMHeader msg;
+    msg.SetVersion(2);
+    msg.SetType(pimdm::PIM_STATE_REF);
+    pimdm::PIMHeader::StateRefreshMessage &state = msg.GetStateRefreshMessage();
+    pimdm::PIMHeader::EncodedGroup eg =
+      { 1, 0, 0, 0, 0, 32, Ipv4Address("225.1.2.3") };
+    state.m_multicastGroupAddr = eg;
+    pimdm::PIMHeader::EncodedUnicast eu =
+      { 1, 0, Ipv4Address("10.1.1.1") };
+    state.m_sourceAddr = eu;
+    pimdm::PIMHeader::EncodedUnicast ou =
+      { 1, 0, Ipv4Address("10.2.2.2") };
+    state.m_originatorAddr = ou;
+    state.m_R = 0;
+    state.m_metricPreference = 110;
+    state.m_metric = 20;
+    state.m_maskLength = 32;
+    state.m_ttl = ttl;
+    state.m_P = P;
+    state.m_N = N;
+    state.m_O = 0;
+    state.m_reserved = 0;
+    state.m_interval = 60;
+    return msg;
+  }
+
+  class PimDmStateRefreshPatchTestCase : public TestCase
+  {
+    public:
+      PimDmStateRefreshPatchTestCase ();
+      virtual void
+      DoRun (void);
+  };
+
+  PimDmStateRefreshPatchTestCase::PimDmStateRefreshPatchTestCase () :
+      TestCase("Check PIM-DM State Refresh messages patched in place")
+  {
+  }
+  void
+  PimDmStateRefreshPatchTestCase::DoRun (void)
+  {
+    std::vector<uint8_t> patched = SerializePim(StateRefreshSample(16, 0, 0));
+    uint8_t ttls[] =
+      { 15, 1, 255, 16 };
+    for (uint32_t k = 0; k < sizeof(ttls); k++)
+      {
+        pimdm::PIMHeader msg = StateRefreshSample(ttls[k], k % 2, (k / 2) % 2);
+        pimdm::PIMHeader::PatchStateRefresh(patched, msg.GetStateRefreshMessage());
+        std::vector<uint8_t> full = SerializePim(msg);
+        NS_TEST_ASSERT_MSG_EQ(patched.size(), full.size(), "Size");
+        for (uint32_t j = 0; j < full.size(); j++)
+          NS_TEST_ASSERT_MSG_EQ((uint16_t) patched[j], (uint16_t) full[j], "Byte " << j << " with TTL " << (uint16_t) ttls[k]);
+        Packet packet(&patched[0], patched.size());
+        pimdm::PIMHeader msgOut;
+        packet.RemoveHeader(msgOut); // asserts on a wrong checksum
+        NS_TEST_ASSERT_MSG_EQ((uint16_t) msgOut.GetStateRefreshMessage().m_ttl, (uint16_t) ttls[k], "TTL");
+        NS_TEST_ASSERT_MSG_EQ((uint16_t) msgOut.GetStateRefreshMessage().m_P, (uint16_t) (k % 2), "P");
+        NS_TEST_ASSERT_MSG_EQ((uint16_t) msgOut.GetStateRefreshMessage().m_N, (uint16_t) ((k / 2) % 2), "N");
+      }
+  }
+
+  class PimDmJoinPruneViewTestCase : public TestCase
+  {
+    public:
+      PimDmJoinPruneViewTestCase ();
+      virtual void
+      DoRun (void);
+    private:
+      /// Walk the view over bytes, checking the pairs of msg in order, and return the number of pairs read.
+      uint32_t
+      Walk (pimdm::PIMHeader &msg, const std::vector<uint8_t> &bytes);
+  };
+
+  PimDmJoinPruneViewTestCase::PimDmJoinPruneViewTestCase () :
+      TestCase("Check PIM-DM Join-Prune messages decoded in place")
+  {
+  }
+  uint32_t
+  PimDmJoinPruneViewTestCase::Walk (pimdm::PIMHeader &msg, const std::vector<uint8_t> &bytes)
+  {
+    pimdm::JoinPruneGraftView view(&bytes[0], bytes.size());
+    pimdm::PIMHeader::JoinPruneMessage &jp = msg.GetJoinPruneMessage();
+    NS_TEST_EXPECT_MSG_EQ(view.GetType(), pimdm::PIM_JP, "PIM Type");
+    NS_TEST_EXPECT_MSG_EQ(view.GetMessage().m_upstreamNeighborAddr.m_unicastAddress, Ipv4Address("10.0.0.1"),
+        "Upstream Neighbor");
+    NS_TEST_EXPECT_MSG_EQ((uint16_t) view.GetMessage().m_numGroups, (uint16_t) jp.m_joinPruneMessage.m_numGroups,
+        "Groups");
+    NS_TEST_EXPECT_MSG_EQ(view.GetMessage().m_holdTime, Seconds(210), "Hold Time");
+    uint32_t pairs = 0;
+    for (std::vector<pimdm::PIMHeader::MulticastGroupEntry>::const_iterator g = jp.m_multicastGroups.begin();
+        g != jp.m_multicastGroups.end(); g++)
+      {
+        std::vector<pimdm::PIMHeader::EncodedSource> sources(g->m_joinedSourceAddrs);
+        sources.insert(sources.end(), g->m_prunedSourceAddrs.begin(), g->m_prunedSourceAddrs.end());
+        for (uint32_t j = 0; j < sources.size(); j++)
+          {
+            if (!view.Next())
+              return pairs;
+            pairs++;
+            const pimdm::PIMHeader::EncodedGroup &group = view.GetGroup();
+            const pimdm::PIMHeader::EncodedSource &source = view.GetSource();
+            NS_TEST_EXPECT_MSG_EQ(group.m_groupAddress, g->m_multicastGroupAddr.m_groupAddress, "Group Address");
+            NS_TEST_EXPECT_MSG_EQ((uint16_t) group.m_B, (uint16_t) g->m_multicastGroupAddr.m_B, "B");
+            NS_TEST_EXPECT_MSG_EQ((uint16_t) group.m_maskLength, (uint16_t) g->m_multicastGroupAddr.m_maskLength,
+                "Group Mask Length");
+            NS_TEST_EXPECT_MSG_EQ(source.m_sourceAddress, sources[j].m_sourceAddress, "Source Address");
+            NS_TEST_EXPECT_MSG_EQ((uint16_t) source.m_S, (uint16_t) sources[j].m_S, "S");
+            NS_TEST_EXPECT_MSG_EQ((uint16_t) source.m_W, (uint16_t) sources[j].m_W, "W");
+            NS_TEST_EXPECT_MSG_EQ((uint16_t) source.m_R, (uint16_t) sources[j].m_R, "R");
+            NS_TEST_EXPECT_MSG_EQ(view.IsJoin(), j < g->m_joinedSourceAddrs.size(), "Join or Prune");
+          }
+      }
+    return pairs;
+  }
+  void
+  PimDmJoinPruneViewTestCase::DoRun (void)
+  {
+    pimdm::PIMHeader msg = JoinPruneSample(3);
+    std::vector<uint8_t> bytes = SerializePim(msg);
+    NS_TEST_ASSERT_MSG_EQ(IpChecksum(bytes, PIM_DM_HEADER_SIZE), (uint16_t) (bytes[2] << 8 | bytes[3]), "Checksum");
+    NS_TEST_ASSERT_MSG_EQ(Walk(msg, bytes), 6, "Pairs");
+    pimdm::JoinPruneGraftView view(&bytes[0], bytes.size());
+    while (view.Next())
+      ;
+    NS_TEST_ASSERT_MSG_EQ(view.Next(), false, "Next after the last pair");
+
+    // the header announces a fourth group that is not there
+    pimdm::PIMHeader missing = JoinPruneSample(4);
+    NS_TEST_ASSERT_MSG_EQ(Walk(missing, SerializePim(missing)), 6, "Pairs with a missing group");
+
+    // the buffer ends in the middle of the last source
+    bytes.resize(bytes.size() - 3);
+    uint16_t checksum = IpChecksum(bytes, PIM_DM_HEADER_SIZE);
+    bytes[2] = checksum >> 8;
+    bytes[3] = checksum & 0xff;
+    NS_TEST_ASSERT_MSG_EQ(Walk(msg, bytes), 5, "Pairs of a truncated message");
+    pimdm::JoinPruneGraftView truncated(&bytes[0], bytes.size());
+    for (uint32_t j = 0; j < 5; j++)
+      NS_TEST_ASSERT_MSG_EQ(truncated.Next(), true, "Complete pair " << j);
+    NS_TEST_ASSERT_MSG_EQ(truncated.Next(), false, "Truncated pair");
+  }
+
+  class PimDmChecksumTestCase : public TestCase
+  {
+    public:
+      PimDmChecksumTestCase ();
+      virtual void
+      DoRun (void);
+  };
+
+  PimDmChecksumTestCase::PimDmChecksumTestCase () :
+      TestCase("Check PIM-DM checksums computed while serializing")
+  {
+  }
+  void
+  PimDmChecksumTestCase::DoRun (void)
+  {
+    std::vector<pimdm::PIMHeader> samples;
+    samples.push_back(JoinPruneSample(3));
+    samples.push_back(StateRefreshSample(16, 1, 0));
+      {
+        pimdm::PIMHeader hello;
+        hello.SetVersion(2);
+        hello.SetType(pimdm::PIM_HELLO);
+        hello.SetReserved(0);
+        pimdm::PIMHeader::HelloMessage::HelloEntry holdTime;
+        holdTime.m_optionType = pimdm::PIMHeader::HelloMessage::HelloHoldTime;
+        holdTime.m_optionLength = PIM_DM_HELLO_HOLDTIME;
+        holdTime.m_optionValue.holdTime.s_holdTime = Seconds(105);
+        hello.GetHelloMessage().m_optionList.push_back(holdTime);
+        pimdm::PIMHeader::HelloMessage::HelloEntry generationId;
+        generationId.m_optionType = pimdm::PIMHeader::HelloMessage::GenerationID;
+        generationId.m_optionLength = PIM_DM_HELLO_GENERATIONID;
+        generationId.m_optionValue.generationID.s_generatioID = 0x89abcdef;
+        hello.GetHelloMessage().m_optionList.push_back(generationId);
+        samples.push_back(hello);
+      }
+      {
+        pimdm::PIMHeader assert;
+        assert.SetVersion(2);
+        assert.SetType(pimdm::PIM_ASSERT);
+        assert.SetReserved(0);
+        pimdm::PIMHeader::AssertMessage &assertMessage = assert.GetAssertMessage();
+        pimdm::PIMHeader::EncodedGroup eg =
+          { 1, 0, 0, 0, 0, 32, Ipv4Address("225.1.2.3") };
+        assertMessage.m_multicastGroupAddr = eg;
+        pimdm::PIMHeader::EncodedUnicast eu =
+          { 1, 0, Ipv4Address("10.1.1.1") };
+        assertMessage.m_sourceAddr = eu;
+        assertMessage.m_R = 1;
+        assertMessage.m_metricPreference = 110;
+        assertMessage.m_metric = 0xfffe;
+        samples.push_back(assert);
+      }
+    for (uint32_t k = 0; k < samples.size(); k++)
+      {
+        std::vector<uint8_t> bytes = SerializePim(samples[k]);
+        NS_TEST_ASSERT_MSG_EQ(IpChecksum(bytes, PIM_DM_HEADER_SIZE), (uint16_t) (bytes[2] << 8 | bytes[3]),
+            "Checksum of message type " << samples[k].GetType());
+        Packet packet(&bytes[0], bytes.size());
+        pimdm::PIMHeader msgOut;
+        NS_TEST_ASSERT_MSG_EQ(packet.RemoveHeader(msgOut), bytes.size(), "Deserialized size");
+        NS_TEST_ASSERT_MSG_EQ(msgOut.GetChecksum(), (uint16_t) (bytes[2] << 8 | bytes[3]), "Checksum read");
+      }
+
+    // bodies of odd length, with 16 and 32 bit fields across word boundaries
+    for (uint32_t size = 1; size <= 9; size += 2)
+      {
+        Buffer buffer;
+        buffer.AddAtStart(size);
+        pimdm::ChecksumIterator writer(buffer.Begin());
+        writer.WriteU8(0xa5);
+        if (size >= 3)
+          writer.WriteHtonU16(0xfe01);
+        if (size >= 7)
+          writer.WriteHtonU32(0x80ff7f01);
+        for (uint32_t j = (size >= 7 ? 7 : size >= 3 ? 3 : 1); j < size; j++)
+          writer.WriteU8(0x10 * j + 3);
+        Buffer::Iterator i = buffer.Begin();
+        uint16_t checksum = i.CalculateIpChecksum(size, 0);
+        NS_TEST_ASSERT_MSG_EQ(writer.GetChecksum(), checksum, "Checksum written over " << size << " bytes");
+        pimdm::ChecksumIterator reader(buffer.Begin());
+        for (uint32_t j = 0; j < size; j++)
+          reader.ReadU8();
+        NS_TEST_ASSERT_MSG_EQ(reader.GetChecksum(), checksum, "Checksum read over " << size << " bytes");
+      }
+
+    // State Refresh: the closing zero bytes are part of the message
+    Packet packet;
+    packet.AddHeader(StateRefreshSample(16, 1, 0));
+    NS_TEST_ASSERT_MSG_EQ(packet.GetSize(), PIM_DM_HEADER_SIZE + PIM_DM_REFRESH, "Serialized size");
+    std::vector<uint8_t> bytes(packet.GetSize());
+    packet.CopyData(&bytes[0], bytes.size());
+    for (uint32_t j = bytes.size() - PIM_DM_REFRESH_PAD; j < bytes.size(); j++)
+      NS_TEST_ASSERT_MSG_EQ((uint16_t) bytes[j], 0, "Padding byte " << j);
+    pimdm::PIMHeader msgOut;
+    NS_TEST_ASSERT_MSG_EQ(packet.RemoveHeader(msgOut), PIM_DM_HEADER_SIZE + PIM_DM_REFRESH, "Deserialized size");
+    NS_TEST_ASSERT_MSG_EQ(packet.GetSize(), 0, "Bytes left");
+  }
+
   static class PimDmTestSuite : public TestSuite
   {
     public:
@@ -489,6 +795,9 @@ namespace ns3
     AddTestCase(new PimDmJoinPruneTestCase()); //graft and graftAck are identical in format to the Join/Prune Message
     AddTestCase(new PimDmAssertTestCase());
     AddTestCase(new PimDmStateRefreshTestCase());
+    AddTestCase(new PimDmStateRefreshPatchTestCase());
+    AddTestCase(new PimDmJoinPruneViewTestCase());
+    AddTestCase(new PimDmChecksumTestCase());
   }
 
 } // namespace ns3